@@ -0,0 +1,553 @@
+#ifndef ADAPTIVEICOSPHERE_H
+#define ADAPTIVEICOSPHERE_H
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "icosphere.h"
+
+namespace ico
+{
+
+// View-dependent icosphere refinement.
+//
+// The sphere is a forest of triangles rooted at the 20 icosahedron faces and
+// split 1:4 exactly like SubdivideMesh. The forest survives from frame to
+// frame: each update() only splits leaves whose screen-space error grew past
+// the threshold and merges groups whose parent error dropped well below it,
+// within a per-frame budget and a total triangle budget.
+//
+// Neighbouring leaves are kept within one level of each other (splitting a
+// leaf first splits any coarser neighbour). A leaf whose neighbour is one level
+// finer gets the shared midpoints stitched into its triangulation, so the
+// output has no T-junctions and therefore no cracks.
+//
+// Merging gives back what splitting took: node blocks, and midpoint vertices
+// once no split face uses them any more, so memory follows the current
+// refinement rather than everything the camera has visited.
+class AdaptiveSphere final
+{
+public:
+    struct Settings
+    {
+        float edgePixels = 24.0f;       // split when a projected edge is longer
+        float silhouettePixels = 0.5f;  // split silhouette faces above this chord error
+        float mergeRatio = 0.5f;        // merge when the parent error falls below ratio * threshold
+        uint32_t maxLevel = 16;
+        size_t maxTriangles = 200000;
+        size_t maxChangesPerFrame = 4096;
+    };
+
+    // viewProjection is column-major (QMatrix4x4::constData()) and maps sphere
+    // space to clip space; camera is the eye position in sphere space.
+    // pixelScale is the viewport height divided by 2*tan(fov/2).
+    struct View
+    {
+        const float *viewProjection = nullptr;
+        double cameraX = 0.0, cameraY = 0.0, cameraZ = 0.0;
+        float viewportWidth = 1.0f, viewportHeight = 1.0f;
+        float pixelScale = 1.0f;
+    };
+
+    Settings settings;
+
+    // Flat triangle list (x, y, z per corner) in no particular order. Each
+    // update only rewrites the triangles of leaves that were split, merged or
+    // restitched.
+    std::vector<float> positions;
+
+    AdaptiveSphere()
+    {
+        Mesh base;
+        Icosahedron(base);
+        vertices.assign(base.vertices.begin(), base.vertices.end());
+        for (uint32_t i = 0; i < base.triangleCount(); ++i)
+        {
+            Node node;
+            node.v = {base.triangles[i * 3], base.triangles[i * 3 + 1], base.triangles[i * 3 + 2]};
+            nodes.push_back(node);
+            addOwner(static_cast<int32_t>(i));
+            markDirty(static_cast<int32_t>(i));
+        }
+        leafCount = nodes.size();
+        patch();
+    }
+
+    size_t triangleCount() const { return positions.size() / 9; }
+    size_t leaves() const { return leafCount; }
+
+    // Returns true when positions changed.
+    bool update(const View &view)
+    {
+        std::vector<std::pair<float, int32_t>> splits;
+        std::vector<std::pair<float, int32_t>> merges;
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            const Node &node = nodes[i];
+            if (!node.alive)
+                continue;
+            if (node.children < 0)
+            {
+                const float e = error(node, view);
+                if (e > 1.0f && node.level < settings.maxLevel)
+                    splits.emplace_back(e, static_cast<int32_t>(i));
+            }
+            else if (childrenAreLeaves(node))
+            {
+                const float e = error(node, view);
+                if (e < settings.mergeRatio)
+                    merges.emplace_back(e, static_cast<int32_t>(i));
+            }
+        }
+
+        // Worst offenders first, so a budget cut leaves the least visible
+        // work for later frames.
+        std::sort(splits.begin(), splits.end(), std::greater<std::pair<float, int32_t>>());
+        std::sort(merges.begin(), merges.end());
+
+        // Splits go first: merging frees node blocks that a split could
+        // reuse, which would invalidate the ids collected above. Splits forced
+        // on coarser neighbours count as changes too.
+        size_t changes = 0;
+        for (const auto &split : splits)
+        {
+            if (changes >= settings.maxChangesPerFrame)
+                break;
+            const size_t leavesBefore = leafCount;
+            if (nodes[split.second].children < 0)
+                splitNode(split.second);
+            changes += (leafCount - leavesBefore) / 3;
+        }
+        for (const auto &merge : merges)
+        {
+            if (changes >= settings.maxChangesPerFrame)
+                break;
+            if (tryMerge(merge.second))
+                ++changes;
+        }
+
+        if (changes == 0)
+            return false;
+        patch();
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        std::array<uint32_t, 3> v = {{0, 0, 0}};
+        int32_t parent = -1;
+        int32_t children = -1; // first of four consecutive nodes
+        uint32_t level = 0;
+        bool alive = true;
+
+        // Where this leaf's triangles are in positions.
+        std::array<uint32_t, 4> triangles = {{0, 0, 0, 0}};
+        uint8_t triangleCount = 0;
+        bool dirty = false;
+    };
+
+    struct Midpoint
+    {
+        uint32_t vertex;
+        uint32_t users; // split faces having this edge, one or two
+    };
+
+    static uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+
+    void addOwner(int32_t n)
+    {
+        const Node &node = nodes[n];
+        for (int e = 0; e < 3; ++e)
+        {
+            std::array<int32_t, 2> &owners = edgeOwners.emplace(edgeKey(node.v[e], node.v[(e + 1) % 3]), std::array<int32_t, 2>{{-1, -1}}).first->second;
+            (owners[0] < 0 ? owners[0] : owners[1]) = n;
+        }
+    }
+
+    void removeOwner(int32_t n)
+    {
+        const Node &node = nodes[n];
+        for (int e = 0; e < 3; ++e)
+        {
+            auto it = edgeOwners.find(edgeKey(node.v[e], node.v[(e + 1) % 3]));
+            std::array<int32_t, 2> &owners = it->second;
+            if (owners[0] == n)
+                owners[0] = owners[1];
+            owners[1] = -1;
+            if (owners[0] < 0)
+                edgeOwners.erase(it);
+        }
+    }
+
+    // The node on the other side of edge e of n at the same level, or -1 when
+    // that side is coarser.
+    int32_t neighbour(int32_t n, int e) const
+    {
+        const Node &node = nodes[n];
+        auto it = edgeOwners.find(edgeKey(node.v[e], node.v[(e + 1) % 3]));
+        if (it == edgeOwners.end())
+            return -1;
+        return it->second[0] == n ? it->second[1] : it->second[0];
+    }
+
+    // The midpoint of edge ab, created on first use. Every split face takes
+    // a reference on each of its edges' midpoints.
+    uint32_t midpoint(uint32_t a, uint32_t b)
+    {
+        auto it = midpoints.find(edgeKey(a, b));
+        if (it != midpoints.end())
+        {
+            ++it->second.users;
+            return it->second.vertex;
+        }
+        const Vector3 p = normalize(Vector3(0.5) * (vertices[a] + vertices[b]));
+        uint32_t m;
+        if (!freeVertices.empty())
+        {
+            m = freeVertices.back();
+            freeVertices.pop_back();
+            vertices[m] = p;
+        }
+        else
+        {
+            m = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(p);
+        }
+        midpoints.emplace(edgeKey(a, b), Midpoint{m, 1});
+        return m;
+    }
+
+    void releaseMidpoint(uint32_t a, uint32_t b)
+    {
+        auto it = midpoints.find(edgeKey(a, b));
+        if (--it->second.users > 0)
+            return;
+        freeVertices.push_back(it->second.vertex);
+        midpoints.erase(it);
+    }
+
+    bool childrenAreLeaves(const Node &node) const
+    {
+        for (int c = 0; c < 4; ++c)
+            if (nodes[node.children + c].children >= 0)
+                return false;
+        return true;
+    }
+
+    bool splitNode(int32_t n)
+    {
+        if (nodes[n].level >= settings.maxLevel || leafCount + 3 > settings.maxTriangles)
+            return false;
+
+        // A missing neighbour means the other side is a coarser leaf whose
+        // edge contains ours; it has to be split first to stay balanced.
+        for (int e = 0; e < 3; ++e)
+        {
+            if (neighbour(n, e) >= 0)
+                continue;
+            const int32_t coarser = coarserNeighbour(n, e);
+            if (coarser < 0 || !splitNode(coarser))
+                return false;
+        }
+
+        int32_t first;
+        if (!freeBlocks.empty())
+        {
+            first = freeBlocks.back();
+            freeBlocks.pop_back();
+        }
+        else
+        {
+            first = static_cast<int32_t>(nodes.size());
+            nodes.resize(nodes.size() + 4);
+        }
+
+        const std::array<uint32_t, 3> v = nodes[n].v;
+        const uint32_t m01 = midpoint(v[0], v[1]);
+        const uint32_t m12 = midpoint(v[1], v[2]);
+        const uint32_t m20 = midpoint(v[2], v[0]);
+        const std::array<uint32_t, 3> corners[4] = {
+            {{v[0], m01, m20}}, {{m01, v[1], m12}}, {{m12, v[2], m20}}, {{m01, m12, m20}}
+        };
+        for (int c = 0; c < 4; ++c)
+        {
+            Node child;
+            child.v = corners[c];
+            child.parent = n;
+            child.level = nodes[n].level + 1;
+            nodes[first + c] = child;
+            addOwner(first + c);
+            markDirty(first + c);
+        }
+        nodes[n].children = first;
+        leafCount += 3;
+        markAround(n);
+        return true;
+    }
+
+    // The leaf across edge e of n when that side is one level coarser: it is
+    // the neighbour of n's parent across the parent edge containing e.
+    int32_t coarserNeighbour(int32_t n, int e) const
+    {
+        const Node &node = nodes[n];
+        if (node.parent < 0)
+            return -1;
+        const uint32_t a = node.v[e], b = node.v[(e + 1) % 3];
+        const Node &parent = nodes[node.parent];
+        for (int pe = 0; pe < 3; ++pe)
+        {
+            const uint32_t pa = parent.v[pe], pb = parent.v[(pe + 1) % 3];
+            auto m = midpoints.find(edgeKey(pa, pb));
+            if (m == midpoints.end())
+                continue;
+            if (edgeKey(a, b) == edgeKey(pa, m->second.vertex) || edgeKey(a, b) == edgeKey(m->second.vertex, pb))
+                return neighbour(node.parent, pe);
+        }
+        return -1;
+    }
+
+    bool tryMerge(int32_t n)
+    {
+        Node &node = nodes[n];
+        if (node.children < 0 || !childrenAreLeaves(node))
+            return false;
+
+        // The outer edges of the corner children face the neighbours; if any
+        // of those is split, merging would leave a two-level step.
+        for (int c = 0; c < 3; ++c)
+            for (int e = 0; e < 3; ++e)
+            {
+                const int32_t other = neighbour(node.children + c, e);
+                if (other >= 0 && nodes[other].parent != n && nodes[other].children >= 0)
+                    return false;
+            }
+
+        for (int c = 0; c < 4; ++c)
+        {
+            removeOwner(node.children + c);
+            nodes[node.children + c].alive = false;
+            markDirty(node.children + c);
+        }
+        for (int e = 0; e < 3; ++e)
+            releaseMidpoint(node.v[e], node.v[(e + 1) % 3]);
+        freeBlocks.push_back(node.children);
+        node.children = -1;
+        leafCount -= 3;
+        markAround(n);
+        return true;
+    }
+
+    // Largest of the edge and silhouette errors relative to their thresholds;
+    // zero for faces that are off screen or turned away from the camera.
+    float error(const Node &node, const View &view) const
+    {
+        // The face in clip space, clipped against the near plane (z >= -w)
+        // so that a face reaching behind the eye is measured by its visible
+        // part rather than by a projection that wraps through infinity.
+        const float *m = view.viewProjection;
+        double clip[3][4];
+        for (int i = 0; i < 3; ++i)
+        {
+            const Vector3 &p = vertices[node.v[i]];
+            for (int r = 0; r < 4; ++r)
+                clip[i][r] = m[r] * p.x + m[4 + r] * p.y + m[8 + r] * p.z + m[12 + r];
+        }
+        double polygon[4][4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const double *a = clip[i], *b = clip[(i + 1) % 3];
+            const double da = a[2] + a[3], db = b[2] + b[3];
+            if (da >= 0.0)
+                std::copy(a, a + 4, polygon[count++]);
+            if ((da >= 0.0) != (db >= 0.0))
+            {
+                const double t = da / (da - db);
+                for (int r = 0; r < 4; ++r)
+                    polygon[count][r] = a[r] + t * (b[r] - a[r]);
+                ++count;
+            }
+        }
+        if (count == 0)
+            return 0.0f;
+
+        // Screen positions are clamped to the viewport, so off-screen parts
+        // do not count towards the edge length.
+        float sx[4], sy[4];
+        int left = 0, right = 0, below = 0, above = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const double x = polygon[i][0], y = polygon[i][1], w = std::max(polygon[i][3], 1e-12);
+            left += x < -w;
+            right += x > w;
+            below += y < -w;
+            above += y > w;
+            sx[i] = static_cast<float>(std::min(std::max(x / w * 0.5 + 0.5, 0.0), 1.0) * view.viewportWidth);
+            sy[i] = static_cast<float>(std::min(std::max(y / w * 0.5 + 0.5, 0.0), 1.0) * view.viewportHeight);
+        }
+
+        // Faces are tiny compared to the sphere, so the corner test is a good
+        // enough frustum check.
+        if (left == count || right == count || below == count || above == count)
+            return 0.0f;
+
+        int facing = 0;
+        double distance = 1e30;
+        for (int i = 0; i < 3; ++i)
+        {
+            const Vector3 &p = vertices[node.v[i]];
+            const Vector3 toEye = Vector3(view.cameraX, view.cameraY, view.cameraZ) - p;
+            facing += dot(p, toEye) > 0.0;
+            distance = std::min(distance, length(toEye));
+        }
+        if (facing == 0)
+            return 0.0f;
+
+        float edge = 0.0f;
+        for (int i = 0; i < count; ++i)
+        {
+            const float dx = sx[(i + 1) % count] - sx[i], dy = sy[(i + 1) % count] - sy[i];
+            edge = std::max(edge, std::sqrt(dx * dx + dy * dy));
+        }
+        float e = edge / settings.edgePixels;
+
+        if (facing < 3)
+        {
+            // How far the flat face sits inside the sphere, in pixels at its
+            // distance from the eye.
+            const double chord = length(vertices[node.v[0]] - vertices[node.v[1]]);
+            const double sagitta = 1.0 - std::sqrt(std::max(0.0, 1.0 - chord * chord * 0.25));
+            e = std::max(e, static_cast<float>(sagitta * view.pixelScale / distance / settings.silhouettePixels));
+        }
+        return e;
+    }
+
+    void markDirty(int32_t n)
+    {
+        if (nodes[n].dirty)
+            return;
+        nodes[n].dirty = true;
+        dirty.push_back(n);
+    }
+
+    // A split or merge of n changes the stitching of its same-level
+    // neighbours.
+    void markAround(int32_t n)
+    {
+        markDirty(n);
+        for (int e = 0; e < 3; ++e)
+        {
+            const int32_t other = neighbour(n, e);
+            if (other >= 0)
+                markDirty(other);
+        }
+    }
+
+    // Rewrites the triangles of the dirty nodes: removed for nodes that are
+    // no longer leaves, regenerated for the rest.
+    void patch()
+    {
+        for (int32_t n : dirty)
+        {
+            nodes[n].dirty = false;
+            removeTriangles(n);
+            if (nodes[n].alive && nodes[n].children < 0)
+                addTriangles(n);
+        }
+        dirty.clear();
+    }
+
+    void addTriangles(int32_t n)
+    {
+        const Node &node = nodes[n];
+
+        // Polygon a, [m_ab], b, [m_bc], c, [m_ca] with the midpoints a finer
+        // neighbour introduced on the shared edge.
+        uint32_t polygon[6];
+        int size = 0, split = -1, splits = 0;
+        for (int e = 0; e < 3; ++e)
+        {
+            polygon[size++] = node.v[e];
+            const int32_t other = neighbour(n, e);
+            if (other >= 0 && nodes[other].children >= 0)
+            {
+                if (split < 0)
+                    split = size;
+                ++splits;
+                polygon[size++] = midpoints.at(edgeKey(node.v[e], node.v[(e + 1) % 3])).vertex;
+            }
+        }
+
+        if (splits == 0)
+            addTriangle(n, polygon[0], polygon[1], polygon[2]);
+        else if (splits == 3)
+        {
+            addTriangle(n, polygon[0], polygon[1], polygon[5]);
+            addTriangle(n, polygon[1], polygon[2], polygon[3]);
+            addTriangle(n, polygon[3], polygon[4], polygon[5]);
+            addTriangle(n, polygon[1], polygon[3], polygon[5]);
+        }
+        else
+        {
+            // Fan around the first midpoint.
+            for (int k = 1; k < size - 1; ++k)
+                addTriangle(n, polygon[split], polygon[(split + k) % size], polygon[(split + k + 1) % size]);
+        }
+    }
+
+    void addTriangle(int32_t n, uint32_t a, uint32_t b, uint32_t c)
+    {
+        Node &node = nodes[n];
+        node.triangles[node.triangleCount++] = static_cast<uint32_t>(triangleOwners.size());
+        triangleOwners.push_back(n);
+        for (uint32_t v : {a, b, c})
+        {
+            positions.push_back(static_cast<float>(vertices[v].x));
+            positions.push_back(static_cast<float>(vertices[v].y));
+            positions.push_back(static_cast<float>(vertices[v].z));
+        }
+    }
+
+    // Fills each freed slot with the last triangle, so positions stays dense.
+    void removeTriangles(int32_t n)
+    {
+        for (int k = 0; k < nodes[n].triangleCount; ++k)
+        {
+            const uint32_t t = nodes[n].triangles[k];
+            const uint32_t last = static_cast<uint32_t>(triangleOwners.size() - 1);
+            if (t != last)
+            {
+                std::copy(positions.begin() + last * 9, positions.begin() + last * 9 + 9, positions.begin() + t * 9);
+                Node &moved = nodes[triangleOwners[last]];
+                for (int j = 0; j < moved.triangleCount; ++j)
+                    if (moved.triangles[j] == last)
+                        moved.triangles[j] = t;
+                triangleOwners[t] = triangleOwners[last];
+            }
+            triangleOwners.pop_back();
+            positions.resize(positions.size() - 9);
+        }
+        nodes[n].triangleCount = 0;
+    }
+
+    std::vector<Vector3> vertices;
+    std::vector<uint32_t> freeVertices;
+    std::unordered_map<uint64_t, Midpoint> midpoints;
+    std::unordered_map<uint64_t, std::array<int32_t, 2>> edgeOwners;
+    std::vector<Node> nodes;
+    std::vector<int32_t> freeBlocks;
+    std::vector<int32_t> dirty;
+    std::vector<int32_t> triangleOwners; // node of each triangle in positions
+    size_t leafCount = 0;
+};
+
+}
+
+#endif // ADAPTIVEICOSPHERE_H
@@ -1,3 +1,6 @@
+#ifndef CUBE_H
+#define CUBE_H
+
 #include <array>
 #include <deque>
 #include <algorithm>
@@ -55,4 +58,4 @@ public:
 	}
 };
 
-
+#endif // CUBE_H
@@ -0,0 +1,235 @@
+#ifndef FACEINDEX_H
+#define FACEINDEX_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "icosphere.h"
+#include "jobSystem.h"
+
+namespace ico
+{
+
+// Direction -> face lookup on the icosphere, without building it.
+//
+// Faces are named the way SubdivideMesh numbers them: triangle t of one level
+// has children 4t .. 4t+3 on the next (three corners, then the middle), so
+// the face id at level N is the base face followed by N base-4 digits, and is
+// the triangle index into the level N mesh. locate() descends from the 20 base
+// faces, picking a child per level with three plane tests against the edge
+// midpoints, which are recomputed exactly as SubdivideMesh computes them.
+//
+// Edge e of a face runs from its corner e to corner (e + 1) % 3, and
+// neighbours() walks the same digits to find the face across each edge.
+class FaceIndex final
+{
+public:
+    typedef uint64_t FaceId;
+
+    // 20 * 4^29 still fits the id.
+    static const uint32_t MaxLevel = 29;
+
+    FaceIndex()
+    {
+        Mesh base;
+        Icosahedron(base);
+        for (uint32_t f = 0; f < BaseFaces; ++f)
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                baseVertices.push_back(base.vertices[base.triangles[f * 3 + c]]);
+                baseCorners[f][c] = base.triangles[f * 3 + c];
+            }
+
+        for (uint32_t f = 0; f < BaseFaces; ++f)
+            for (uint32_t e = 0; e < 3; ++e)
+            {
+                const uint32_t from = baseCorners[f][e], to = baseCorners[f][(e + 1) % 3];
+                for (uint32_t g = 0; g < BaseFaces; ++g)
+                    for (uint32_t h = 0; h < 3; ++h)
+                        if (baseCorners[g][h] == to && baseCorners[g][(h + 1) % 3] == from)
+                            baseAcross[f][e] = Edge{g, h};
+            }
+    }
+
+    static FaceId faceCount(uint32_t level) { return FaceId(BaseFaces) << (2 * level); }
+
+    // Unit direction for a latitude and longitude in radians, y up.
+    static Vector3 direction(double latitude, double longitude)
+    {
+        const double c = std::cos(latitude);
+        return Vector3(c * std::cos(longitude), std::sin(latitude), c * std::sin(longitude));
+    }
+
+    // The face at level containing direction d, which need not be unit length.
+    // Points on an edge go to one of the two faces consistently.
+    FaceId locate(const Vector3 &d, uint32_t level) const
+    {
+        uint32_t face = 0;
+        for (uint32_t f = 0; f < BaseFaces; ++f)
+        {
+            if (inside(d, baseVertices[f * 3], baseVertices[f * 3 + 1], baseVertices[f * 3 + 2]))
+            {
+                face = f;
+                break;
+            }
+        }
+
+        FaceId id = face;
+        Vector3 a = baseVertices[face * 3], b = baseVertices[face * 3 + 1], c = baseVertices[face * 3 + 2];
+        for (uint32_t l = 0; l < level; ++l)
+        {
+            const Vector3 ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            uint32_t child;
+            if (dot(d, cross(ab, ca)) >= 0.0)
+            {
+                child = 0;
+                b = ab;
+                c = ca;
+            }
+            else if (dot(d, cross(bc, ab)) >= 0.0)
+            {
+                child = 1;
+                a = ab;
+                c = bc;
+            }
+            else if (dot(d, cross(ca, bc)) >= 0.0)
+            {
+                child = 2;
+                a = bc;
+                b = c;
+                c = ca;
+            }
+            else
+            {
+                child = 3;
+                a = ab;
+                b = bc;
+                c = ca;
+            }
+            id = id * 4 + child;
+        }
+        return id;
+    }
+
+    // Locates count directions (x, y, z each) into faces, in parallel.
+    void locate(const float *directions, size_t count, uint32_t level, FaceId *faces, JobSystem &jobs) const
+    {
+        jobs.parallelFor(count, 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+                faces[i] = locate(Vector3(directions[i * 3], directions[i * 3 + 1], directions[i * 3 + 2]), level);
+        });
+    }
+
+    // Same, for latitude and longitude pairs in radians.
+    void locateLatLong(const double *latLong, size_t count, uint32_t level, FaceId *faces, JobSystem &jobs) const
+    {
+        jobs.parallelFor(count, 4096, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+                faces[i] = locate(direction(latLong[i * 2], latLong[i * 2 + 1]), level);
+        });
+    }
+
+    // The three corners of face, on the unit sphere.
+    std::array<Vector3, 3> corners(FaceId face, uint32_t level) const
+    {
+        const uint32_t base = uint32_t(face >> (2 * level));
+        Vector3 a = baseVertices[base * 3], b = baseVertices[base * 3 + 1], c = baseVertices[base * 3 + 2];
+        for (uint32_t l = level; l-- > 0;)
+        {
+            const Vector3 ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            switch ((face >> (2 * l)) & 3)
+            {
+            case 0: b = ab; c = ca; break;
+            case 1: a = ab; c = bc; break;
+            case 2: a = bc; b = c; c = ca; break;
+            default: a = ab; b = bc; c = ca; break;
+            }
+        }
+        return {{a, b, c}};
+    }
+
+    // The faces across edges 0, 1 and 2 of face, in O(level).
+    std::array<FaceId, 3> neighbours(FaceId face, uint32_t level) const
+    {
+        return {{across(face, level, 0).face, across(face, level, 1).face, across(face, level, 2).face}};
+    }
+
+private:
+    static const uint32_t BaseFaces = 20;
+
+    struct Edge
+    {
+        uint32_t face;
+        uint32_t edge;
+    };
+
+    struct Neighbour
+    {
+        FaceId face;
+        uint32_t edge; // the shared edge as numbered by face
+    };
+
+    static Vector3 midpoint(const Vector3 &a, const Vector3 &b)
+    {
+        return normalize(Vector3(0.5) * (a + b));
+    }
+
+    static bool inside(const Vector3 &d, const Vector3 &a, const Vector3 &b, const Vector3 &c)
+    {
+        return dot(d, cross(a, b)) >= 0.0 && dot(d, cross(b, c)) >= 0.0 && dot(d, cross(c, a)) >= 0.0;
+    }
+
+    Neighbour across(FaceId face, uint32_t level, uint32_t edge) const
+    {
+        if (level == 0)
+        {
+            const Edge &e = baseAcross[face][edge];
+            return Neighbour{e.face, e.edge};
+        }
+
+        // Each edge of a child either borders a sibling or is one half of a
+        // parent edge.
+        struct Step
+        {
+            bool outer;
+            uint32_t index; // sibling, or parent edge
+            uint32_t edge;  // sibling edge, or half of the parent edge
+        };
+        static const Step steps[4][3] = {
+            {{true, 0, 0}, {false, 3, 2}, {true, 2, 1}},
+            {{true, 0, 1}, {true, 1, 0}, {false, 3, 0}},
+            {{true, 1, 1}, {true, 2, 0}, {false, 3, 1}},
+            {{false, 1, 2}, {false, 2, 2}, {false, 0, 1}},
+        };
+        // The inverse for outer edges: the child and child edge covering the
+        // first and second half of each parent edge.
+        static const Edge halves[3][2] = {
+            {{0, 0}, {1, 0}},
+            {{1, 1}, {2, 0}},
+            {{2, 1}, {0, 2}},
+        };
+
+        const FaceId parent = face >> 2;
+        const Step &step = steps[face & 3][edge];
+        if (!step.outer)
+            return Neighbour{parent * 4 + step.index, step.edge};
+
+        // The neighbour runs along the same parent edge the other way, so the
+        // halves swap.
+        const Neighbour outside = across(parent, level - 1, step.index);
+        const Edge &match = halves[outside.edge][1 - step.edge];
+        return Neighbour{outside.face * 4 + match.face, match.edge};
+    }
+
+    std::vector<Vector3> baseVertices;
+    uint32_t baseCorners[BaseFaces][3] = {};
+    Edge baseAcross[BaseFaces][3] = {};
+};
+
+}
+
+#endif // FACEINDEX_H
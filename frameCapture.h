@@ -0,0 +1,375 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QOpenGLExtraFunctions>
+#include <QSize>
+#include <QString>
+#include "logging.h"
+
+enum class CaptureFormat
+{
+    Raw,  // RGBA8 frames back to back, top row first
+    Y4m,  // YUV4MPEG2, 4:4:4, BT.601 studio range
+    Png   // one numbered file per frame
+};
+
+inline const char* captureFormatName(CaptureFormat format)
+{
+    switch (format)
+    {
+    case CaptureFormat::Raw: return "raw";
+    case CaptureFormat::Y4m: return "y4m";
+    case CaptureFormat::Png: return "png";
+    }
+    return "?";
+}
+
+inline bool parseCaptureFormat(const QString& name, CaptureFormat& format)
+{
+    for (CaptureFormat candidate : {CaptureFormat::Raw, CaptureFormat::Y4m, CaptureFormat::Png})
+    {
+        if (name.compare(QLatin1String(captureFormatName(candidate)), Qt::CaseInsensitive) == 0)
+        {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Records the default framebuffer to disk without stalling the render loop.
+//
+// capture() is called once per frame, after rendering and before the swap.
+// It starts an asynchronous glReadPixels into one of a ring of pixel buffer
+// objects and fences it; a later call maps the buffers whose fences have
+// signalled, copies the pixels out and hands them to a writer thread. When
+// every buffer is still in flight, or the writer's queue is full, the frame
+// is dropped and counted instead of waiting.
+class FrameCapture final
+{
+public:
+    struct Stats
+    {
+        size_t written = 0;
+        size_t droppedGpu = 0;    // all pixel buffers still in flight
+        size_t droppedWriter = 0; // the writer had too many frames queued
+        size_t droppedSize = 0;   // the window no longer matched the first frame
+
+        size_t dropped() const { return droppedGpu + droppedWriter + droppedSize; }
+    };
+
+    ~FrameCapture()
+    {
+        stopWriter();
+    }
+
+    bool active() const { return recording; }
+
+    // Opens the output. Does not need a GL context.
+    bool start(const QString& path, CaptureFormat format, int framesPerSecond)
+    {
+        if (recording)
+            return false;
+
+        outputPath = path;
+        outputFormat = format;
+        fps = framesPerSecond > 0 ? framesPerSecond : 60;
+        frameSize = QSize();
+        frameIndex = 0;
+        stats = Stats();
+        reportedDrops = 0;
+        if (format != CaptureFormat::Png)
+        {
+            file = std::fopen(QFile::encodeName(path).constData(), "wb");
+            if (!file)
+            {
+                qWarning() << "capture: cannot open" << path;
+                return false;
+            }
+        }
+
+        stopping = false;
+        writer = std::thread([this] { writerLoop(); });
+        recording = true;
+        qCInfo(lcCapture) << "recording" << captureFormatName(format) << "to" << path;
+        return true;
+    }
+
+    // Waits for the frames still in flight, flushes the writer and closes the
+    // output. Needs the context current.
+    void stop(QOpenGLExtraFunctions* f)
+    {
+        if (!recording)
+            return;
+        harvest(f, true);
+        stopWriter();
+        recording = false;
+
+        for (Slot& slot : readbacks)
+        {
+            if (slot.busy)
+                f->glDeleteSync(slot.fence);
+            f->glDeleteBuffers(1, &slot.buffer);
+            slot = Slot();
+        }
+        qCInfo(lcCapture) << stats.written << "frames of" << frameSize << "written to" << outputPath
+                          << "," << stats.dropped() << "dropped (" << stats.droppedGpu << "gpu," << stats.droppedWriter
+                          << "writer," << stats.droppedSize << "resized )";
+    }
+
+    // Queues a readback of the bound framebuffer of the given size in pixels.
+    void capture(QOpenGLExtraFunctions* f, const QSize& size)
+    {
+        if (!recording)
+            return;
+        harvest(f, false);
+
+        if (frameSize.isEmpty())
+            allocate(f, size);
+        if (size != frameSize)
+        {
+            ++stats.droppedSize;
+            reportDrops();
+            return;
+        }
+
+        Slot& slot = readbacks[next];
+        if (slot.busy)
+        {
+            ++stats.droppedGpu;
+            reportDrops();
+            return;
+        }
+
+        f->glReadBuffer(GL_BACK);
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        f->glReadPixels(0, 0, frameSize.width(), frameSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.busy = true;
+        slot.index = frameIndex++;
+        next = (next + 1) % SlotCount;
+    }
+
+private:
+    static const int SlotCount = 3;
+    static const size_t MaxQueued = 8;
+
+    struct Slot
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        bool busy = false;
+        size_t index = 0;
+    };
+
+    struct Frame
+    {
+        std::vector<uint8_t> pixels; // RGBA, bottom row first as read
+        size_t index = 0;
+    };
+
+    void allocate(QOpenGLExtraFunctions* f, const QSize& size)
+    {
+        frameSize = size;
+        const GLsizeiptr bytes = GLsizeiptr(size.width()) * size.height() * 4;
+        for (Slot& slot : readbacks)
+        {
+            f->glGenBuffers(1, &slot.buffer);
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            f->glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        }
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (outputFormat == CaptureFormat::Y4m)
+        {
+            std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", size.width(), size.height(), fps);
+        }
+        else if (outputFormat == CaptureFormat::Raw)
+            qCInfo(lcCapture) << "raw frames are" << size.width() << "x" << size.height() << "RGBA8";
+    }
+
+    // Hands finished readbacks to the writer, oldest first. Without wait, stops
+    // at the first one the GPU has not finished.
+    void harvest(QOpenGLExtraFunctions* f, bool wait)
+    {
+        for (int i = 0; i < SlotCount; ++i)
+        {
+            Slot& slot = readbacks[(next + i) % SlotCount];
+            if (!slot.busy)
+                continue;
+            const GLenum state = f->glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GLuint64(1000000000) : 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+                return;
+            f->glDeleteSync(slot.fence);
+            slot.busy = false;
+
+            Frame frame;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (queue.size() >= MaxQueued)
+                {
+                    ++stats.droppedWriter;
+                    reportDrops();
+                    continue;
+                }
+                if (!spare.empty())
+                {
+                    frame.pixels.swap(spare.back());
+                    spare.pop_back();
+                }
+            }
+
+            const size_t bytes = size_t(frameSize.width()) * frameSize.height() * 4;
+            frame.pixels.resize(bytes);
+            frame.index = slot.index;
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            if (const void* mapped = f->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(bytes), GL_MAP_READ_BIT))
+            {
+                std::memcpy(frame.pixels.data(), mapped, bytes);
+                f->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    queue.push_back(std::move(frame));
+                }
+                wakeUp.notify_one();
+            }
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    void reportDrops()
+    {
+        // Once when dropping starts, then every 100 drops.
+        const size_t dropped = stats.dropped();
+        if (dropped == 1 || dropped >= reportedDrops + 100)
+        {
+            reportedDrops = dropped;
+            qWarning() << "capture: falling behind," << dropped << "frames dropped so far";
+        }
+    }
+
+    void writerLoop()
+    {
+        for (;;)
+        {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            write(frame);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.written;
+            spare.push_back(std::move(frame.pixels));
+        }
+    }
+
+    // Runs on the writer thread.
+    void write(const Frame& frame)
+    {
+        const int width = frameSize.width(), height = frameSize.height();
+        const size_t stride = size_t(width) * 4;
+        switch (outputFormat)
+        {
+        case CaptureFormat::Raw:
+            for (int y = height; y-- > 0;)
+                std::fwrite(&frame.pixels[y * stride], 1, stride, file);
+            break;
+        case CaptureFormat::Y4m:
+        {
+            planes.resize(size_t(width) * height * 3);
+            uint8_t* planeY = planes.data();
+            uint8_t* planeU = planeY + size_t(width) * height;
+            uint8_t* planeV = planeU + size_t(width) * height;
+            for (int y = 0; y < height; ++y)
+            {
+                const uint8_t* row = &frame.pixels[(height - 1 - y) * stride];
+                for (int x = 0; x < width; ++x)
+                {
+                    const int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+                    const size_t i = size_t(y) * width + x;
+                    planeY[i] = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                    planeU[i] = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                    planeV[i] = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+                }
+            }
+            std::fputs("FRAME\n", file);
+            std::fwrite(planes.data(), 1, planes.size(), file);
+            break;
+        }
+        case CaptureFormat::Png:
+        {
+            const QFileInfo info(outputPath);
+            const QString name = QStringLiteral("%1/%2_%3.png").arg(info.path(), info.completeBaseName())
+                                     .arg(frame.index, 5, 10, QLatin1Char('0'));
+            const QImage image(frame.pixels.data(), width, height, int(stride), QImage::Format_RGBA8888);
+            if (!image.mirrored().save(name))
+                qWarning() << "capture: cannot write" << name;
+            break;
+        }
+        }
+    }
+
+    void stopWriter()
+    {
+        if (writer.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeUp.notify_all();
+            writer.join();
+        }
+        if (file)
+        {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    bool recording = false;
+    QString outputPath;
+    CaptureFormat outputFormat = CaptureFormat::Y4m;
+    int fps = 60;
+    QSize frameSize;
+    size_t frameIndex = 0;
+    size_t reportedDrops = 0;
+    Stats stats;
+
+    Slot readbacks[SlotCount];
+    int next = 0;
+
+    // Shared with the writer thread.
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<Frame> queue;
+    std::vector<std::vector<uint8_t>> spare;
+    bool stopping = false;
+    std::thread writer;
+
+    // Header written by the render thread, frames by the writer.
+    std::FILE* file = nullptr;
+    std::vector<uint8_t> planes;
+};
+
+#endif // FRAMECAPTURE_H
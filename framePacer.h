@@ -0,0 +1,216 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLExtraFunctions>
+#include <QSurfaceFormat>
+#include <QThread>
+
+#include "logging.h"
+
+struct PacingSettings
+{
+    int swapInterval = 1;          // applied through the surface format
+    int renderAhead = 2;           // frames the GPU may lag behind, 0 for no limit
+    bool predictLateFrames = false;
+    bool latencyProbe = false;
+};
+
+// Matches input events to the first frame rendered after them and records
+// how long it took until the GPU finished that frame. Input is stamped when
+// the window sees the event, and completion is observed at the next fence
+// check, so the numbers are an upper bound on the application's share of the
+// latency; scan-out adds up to one refresh on top.
+class LatencyProbe final
+{
+public:
+    void input(qint64 now)
+    {
+        if (pendingInput < 0)
+            pendingInput = now;
+    }
+
+    void frameBegun(qint64 frame)
+    {
+        if (pendingInput < 0)
+            return;
+        inFlight.push_back(Sample{frame, pendingInput});
+        pendingInput = -1;
+    }
+
+    void frameCompleted(qint64 frame, qint64 now)
+    {
+        while (!inFlight.empty() && inFlight.front().frame <= frame)
+        {
+            samples.push_back((now - inFlight.front().input) / 1e6);
+            inFlight.pop_front();
+        }
+        if (samples.size() >= 100)
+            report();
+    }
+
+    void report()
+    {
+        if (samples.empty())
+            return;
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [this](double p) { return samples[std::min(samples.size() - 1, size_t(p * samples.size()))]; };
+        qCInfo(lcPacing) << "input latency over" << samples.size() << "events: min" << samples.front()
+                         << "p50" << percentile(0.5) << "p90" << percentile(0.9) << "p99" << percentile(0.99)
+                         << "max" << samples.back() << "ms";
+        samples.clear();
+    }
+
+private:
+    struct Sample
+    {
+        qint64 frame;
+        qint64 input;
+    };
+
+    qint64 pendingInput = -1;
+    std::deque<Sample> inFlight;
+    std::vector<double> samples;
+};
+
+// Paces frames around swapBuffers().
+//
+// Every swap is followed by a fence. Before a new frame starts, the pacer
+// waits for old fences until at most renderAhead - 1 frames are still queued,
+// so the driver cannot buffer up stale frames and input stays fresh.
+//
+// The late-frame predictor keeps a running mean and deviation of the time a
+// frame takes from start to swap. Frames predicted to miss the refresh are
+// counted. When prediction is on, an on-time frame starts as late as it safely
+// can before the next refresh, which shortens the time between reading input
+// and showing the result.
+class FramePacer final
+{
+public:
+    void setSettings(const PacingSettings& newSettings) { settings = newSettings; }
+    const PacingSettings& pacing() const { return settings; }
+
+    // Needs a current context; fences require GL 3.2 or ES 3.0. The latency
+    // probe times frames by their fences, so it stays off without them.
+    void initialize(const QSurfaceFormat& format)
+    {
+        const bool es = format.renderableType() == QSurfaceFormat::OpenGLES;
+        fencesSupported = format.version() >= (es ? qMakePair(3, 0) : qMakePair(3, 2));
+        if (settings.latencyProbe && !fencesSupported)
+            qWarning() << "pacing: latency probe needs fence syncs, disabled";
+        clock.start();
+    }
+
+    void input()
+    {
+        if (probing())
+            probe.input(clock.nsecsElapsed());
+    }
+
+    void beginFrame(QOpenGLExtraFunctions* f, double refreshRate)
+    {
+        period = settings.swapInterval > 0 ? 1e9 * settings.swapInterval / std::max(1.0, refreshRate) : 0.0;
+
+        collect(f, settings.renderAhead > 0 ? settings.renderAhead - 1 : -1);
+
+        const double predicted = cost + 2.0 * deviation;
+        if (period > 0.0 && predicted > period)
+            ++predictedLate;
+        else if (settings.predictLateFrames && period > 0.0 && lastSwap > 0)
+        {
+            const qint64 start = lastSwap + qint64(period - predicted - 1e6);
+            const qint64 now = clock.nsecsElapsed();
+            if (start > now)
+                QThread::usleep((start - now) / 1000);
+        }
+
+        frameStart = clock.nsecsElapsed();
+        if (probing())
+            probe.frameBegun(frame);
+    }
+
+    // Call right before swapBuffers().
+    void frameSubmitted()
+    {
+        const double sample = clock.nsecsElapsed() - frameStart;
+        deviation += (std::fabs(sample - cost) - deviation) * 0.1;
+        cost += (sample - cost) * 0.1;
+    }
+
+    // Call right after swapBuffers().
+    void endFrame(QOpenGLExtraFunctions* f)
+    {
+        const qint64 now = clock.nsecsElapsed();
+        if (period > 0.0 && lastSwap > 0 && now - lastSwap > period * 1.5)
+            ++lateFrames;
+        lastSwap = now;
+
+        if (fencesSupported)
+            fences.push_back(Fence{f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frame});
+        collect(f, -1);
+        ++frame;
+
+        if (frame % 600 == 0)
+            qCDebug(lcPacing) << "swap interval" << settings.swapInterval << "render ahead" << settings.renderAhead
+                              << "-" << lateFrames << "late frames," << predictedLate << "predicted late,"
+                              << "frame cost" << cost / 1e6 << "+-" << deviation / 1e6 << "ms";
+    }
+
+private:
+    struct Fence
+    {
+        GLsync sync;
+        qint64 frame;
+    };
+
+    bool probing() const { return settings.latencyProbe && fencesSupported; }
+
+    // Retires signalled fences. With keep >= 0 it also blocks until no more
+    // than keep fences are outstanding, for up to a second per fence; a frame
+    // still running after that is left for a later call.
+    void collect(QOpenGLExtraFunctions* f, int keep)
+    {
+        while (!fences.empty())
+        {
+            const bool mustWait = keep >= 0 && int(fences.size()) > keep;
+            const GLenum result = f->glClientWaitSync(fences.front().sync, mustWait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                                      mustWait ? GLuint64(1000000000) : 0);
+            if (result == GL_TIMEOUT_EXPIRED)
+                return;
+            if (result == GL_WAIT_FAILED)
+            {
+                // Nothing is known about when this frame finished.
+                f->glDeleteSync(fences.front().sync);
+                fences.pop_front();
+                continue;
+            }
+            if (probing())
+                probe.frameCompleted(fences.front().frame, clock.nsecsElapsed());
+            f->glDeleteSync(fences.front().sync);
+            fences.pop_front();
+        }
+    }
+
+    PacingSettings settings;
+    LatencyProbe probe;
+    QElapsedTimer clock;
+    bool fencesSupported = false;
+    std::deque<Fence> fences;
+
+    qint64 frame = 0;
+    qint64 frameStart = 0;
+    qint64 lastSwap = 0;
+    double period = 0.0;       // nanoseconds between refreshes we sync to
+    double cost = 0.0;         // nanoseconds, smoothed
+    double deviation = 0.0;
+    qint64 lateFrames = 0;
+    qint64 predictedLate = 0;
+};
+
+#endif // FRAMEPACER_H
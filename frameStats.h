@@ -0,0 +1,137 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QElapsedTimer>
+#include <QOpenGLTimerQuery>
+
+// Smoothed frame timings. frameStarted() measures the interval since the
+// previous frame, frameFinished() the CPU time spent submitting this one.
+class FrameStats final
+{
+public:
+    explicit FrameStats(double smoothing = 0.05) : smoothing(smoothing) {}
+
+    void frameStarted()
+    {
+        if (clock.isValid())
+        {
+            lastInterval = clock.nsecsElapsed() / 1e6;
+            interval = frames ? interval + (lastInterval - interval) * smoothing : lastInterval;
+            ++frames;
+        }
+        clock.start();
+    }
+
+    void frameFinished()
+    {
+        lastCpu = clock.nsecsElapsed() / 1e6;
+        cpuTime = frames > 1 ? cpuTime + (lastCpu - cpuTime) * smoothing : lastCpu;
+    }
+
+    void reset()
+    {
+        clock.invalidate();
+        frames = 0;
+        interval = cpuTime = lastInterval = lastCpu = 0.0;
+    }
+
+    // Milliseconds, exponentially smoothed.
+    double frameInterval() const { return interval; }
+    double submitTime() const { return cpuTime; }
+    double lastFrameInterval() const { return lastInterval; }
+    double lastSubmitTime() const { return lastCpu; }
+    qint64 frameCount() const { return frames; }
+
+private:
+    double smoothing;
+    QElapsedTimer clock;
+    qint64 frames = 0;
+    double interval = 0.0;
+    double cpuTime = 0.0;
+    double lastInterval = 0.0;
+    double lastCpu = 0.0;
+};
+
+// Measures the GPU time of each frame with timer queries. Results are read a
+// few frames later, once available, so nothing waits on the GPU; a frame that
+// finds every query still in flight goes unmeasured. Needs desktop GL 3.3,
+// ARB_timer_query or EXT_timer_query.
+class GpuFrameTimer final
+{
+public:
+    // Needs a current context.
+    bool initialize()
+    {
+        for (QOpenGLTimerQuery& query : queries)
+        {
+            if (!query.create())
+            {
+                releaseResources();
+                return false;
+            }
+        }
+        available = true;
+        return true;
+    }
+
+    // Destroys the queries. Needs the context initialize() ran in current.
+    void releaseResources()
+    {
+        for (int i = 0; i < QueryCount; ++i)
+        {
+            queries[i].destroy();
+            pending[i] = false;
+        }
+        available = false;
+        timing = false;
+    }
+
+    bool supported() const { return available; }
+
+    void begin()
+    {
+        timing = available && !pending[next];
+        if (timing)
+            queries[next].begin();
+    }
+
+    void end()
+    {
+        if (!timing)
+            return;
+        queries[next].end();
+        pending[next] = true;
+        next = (next + 1) % QueryCount;
+        timing = false;
+    }
+
+    // Collects finished queries, oldest first, without waiting.
+    void poll()
+    {
+        for (int i = 0; i < QueryCount; ++i)
+        {
+            const int query = (next + i) % QueryCount;
+            if (!pending[query])
+                continue;
+            if (!queries[query].isResultAvailable())
+                return;
+            last = queries[query].waitForResult() / 1e6;
+            pending[query] = false;
+        }
+    }
+
+    // Milliseconds of the latest measured frame, 0 before the first.
+    double lastFrameTime() const { return last; }
+
+private:
+    static const int QueryCount = 3;
+
+    QOpenGLTimerQuery queries[QueryCount];
+    bool pending[QueryCount] = {};
+    int next = 0;
+    bool available = false;
+    bool timing = false;
+    double last = 0.0;
+};
+
+#endif // FRAMESTATS_H
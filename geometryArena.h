@@ -0,0 +1,146 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+
+// One vertex buffer and one index buffer holding many meshes.
+//
+// Meshes are appended to a CPU copy and given a Range: where their indices
+// start and the base vertex they are relative to. upload() sends whatever was
+// added since the last upload. The buffers grow by doubling; growing
+// re-uploads the whole copy, but ranges stay valid since they are offsets.
+class GeometryArena final
+{
+public:
+    struct Range
+    {
+        GLint baseVertex = 0;
+        GLuint firstIndex = 0;
+        GLsizei indexCount = 0;
+    };
+
+    GeometryArena()
+        : vertexBuffer(QOpenGLBuffer::VertexBuffer)
+        , indexBuffer(QOpenGLBuffer::IndexBuffer)
+    {
+    }
+
+    // Adds an indexed mesh with positions of 3 floats and returns its range.
+    size_t add(const GLfloat* positions, size_t vertexCount, const GLuint* indices, size_t indexCount)
+    {
+        Range range;
+        range.baseVertex = GLint(vertices.size() / 3);
+        range.firstIndex = GLuint(this->indices.size());
+        range.indexCount = GLsizei(indexCount);
+        vertices.insert(vertices.end(), positions, positions + vertexCount * 3);
+        this->indices.insert(this->indices.end(), indices, indices + indexCount);
+        ranges.push_back(range);
+        return ranges.size() - 1;
+    }
+
+    // Adds a triangle list with every corner written out, as Objects stores
+    // primitives, welding corners with identical positions.
+    size_t addTriangles(const GLfloat* corners, size_t cornerCount)
+    {
+        struct Key
+        {
+            GLfloat p[3];
+            bool operator ==(const Key& other) const { return std::memcmp(p, other.p, sizeof(p)) == 0; }
+        };
+        struct Hash
+        {
+            size_t operator ()(const Key& key) const
+            {
+                uint32_t bits[3];
+                std::memcpy(bits, key.p, sizeof(bits));
+                return size_t(bits[0]) * 73856093u ^ size_t(bits[1]) * 19349663u ^ size_t(bits[2]) * 83492791u;
+            }
+        };
+
+        std::unordered_map<Key, GLuint, Hash> welded;
+        welded.reserve(cornerCount);
+        std::vector<GLfloat> positions;
+        std::vector<GLuint> cornerIndices(cornerCount);
+        for (size_t i = 0; i < cornerCount; ++i)
+        {
+            Key key;
+            std::memcpy(key.p, corners + i * 3, sizeof(key.p));
+            auto it = welded.emplace(key, GLuint(positions.size() / 3));
+            if (it.second)
+                positions.insert(positions.end(), key.p, key.p + 3);
+            cornerIndices[i] = it.first->second;
+        }
+        return add(positions.data(), positions.size() / 3, cornerIndices.data(), cornerIndices.size());
+    }
+
+    const Range& range(size_t i) const { return ranges[i]; }
+    size_t rangeCount() const { return ranges.size(); }
+
+    // Sends new geometry to the GPU. Needs a context of the share group
+    // current.
+    void upload()
+    {
+        if (!vertexBuffer.isCreated())
+        {
+            vertexBuffer.create();
+            indexBuffer.create();
+            vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+            indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        }
+        uploadTo(vertexBuffer, vertices.data(), vertices.size() * sizeof(GLfloat), uploadedVertexBytes, vertexCapacity);
+        uploadTo(indexBuffer, indices.data(), indices.size() * sizeof(GLuint), uploadedIndexBytes, indexCapacity);
+    }
+
+    // Binds the index buffer and points attribute at the positions.
+    void bind(QOpenGLExtraFunctions* f, GLint attribute)
+    {
+        vertexBuffer.bind();
+        f->glVertexAttribPointer(attribute, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+        vertexBuffer.release();
+        indexBuffer.bind();
+    }
+
+    void release() { indexBuffer.release(); }
+
+    // GPU memory held by the two buffers.
+    size_t bytes() const { return vertexCapacity + indexCapacity; }
+
+private:
+    static void uploadTo(QOpenGLBuffer& buffer, const void* data, size_t bytes, size_t& uploaded, size_t& capacity)
+    {
+        if (bytes == uploaded)
+            return;
+
+        buffer.bind();
+        if (capacity < bytes)
+        {
+            capacity = std::max<size_t>(capacity, 1 << 16);
+            while (capacity < bytes)
+                capacity *= 2;
+            buffer.allocate(int(capacity));
+            uploaded = 0;
+        }
+        buffer.write(int(uploaded), static_cast<const char*>(data) + uploaded, int(bytes - uploaded));
+        buffer.release();
+        uploaded = bytes;
+    }
+
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    std::vector<Range> ranges;
+
+    QOpenGLBuffer vertexBuffer;
+    QOpenGLBuffer indexBuffer;
+    size_t uploadedVertexBytes = 0;
+    size_t uploadedIndexBytes = 0;
+    size_t vertexCapacity = 0;
+    size_t indexCapacity = 0;
+};
+
+#endif // GEOMETRYARENA_H
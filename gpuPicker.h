@@ -0,0 +1,195 @@
+#ifndef GPUPICKER_H
+#define GPUPICKER_H
+
+#include <QObject>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QPoint>
+#include <QSize>
+#include "shaderCache.h"
+
+// Finds the object and triangle under the cursor without stalling the GPU.
+//
+// When a pick is requested, the next frame draws object and triangle IDs into
+// an integer framebuffer, scissored to the one pixel under the cursor. That
+// pixel is read into a pixel buffer object and fenced. A later frame maps the
+// buffer once its fence has signalled, usually one or two frames on, and
+// emits picked(). A small ring of buffers keeps several picks in flight
+// while the mouse moves.
+class GpuPicker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit GpuPicker(QObject* parent = nullptr) : QObject(parent) {}
+
+    // Requests the IDs at pixel, counted from the bottom-left of the render
+    // target. Requests made before the next pick pass are merged.
+    void request(const QPoint& pixel)
+    {
+        wanted = pixel;
+        requested = true;
+    }
+
+    bool pending() const { return requested && !readbacks[next].busy; }
+
+    // Binds the ID framebuffer for a frame of the given size and returns the
+    // bound program. Draw calls then only need to set positions (and the
+    // objectId uniform or the instance attributes) before drawing.
+    const ShaderVariant& begin(const QSize& size, ShaderCache& shaders, bool instanced)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+        ensureResources(f, size);
+
+        f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        f->glViewport(0, 0, size.width(), size.height());
+        f->glEnable(GL_SCISSOR_TEST);
+        f->glScissor(wanted.x(), wanted.y(), 1, 1);
+        const GLuint background[4] = {0, 0, 0, 0};
+        f->glClearBufferuiv(GL_COLOR, 0, background);
+        f->glClear(GL_DEPTH_BUFFER_BIT);
+        f->glEnable(GL_DEPTH_TEST);
+        f->glDisable(GL_POLYGON_OFFSET_FILL);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        const ShaderVariant& variant = shaders.program(ShaderFeature::Picking | (instanced ? ShaderFeature::Instancing : ShaderFeature::None));
+        variant.program->bind();
+        return variant;
+    }
+
+    // Queues the readback of the picked pixel and restores the default
+    // framebuffer.
+    void end(const ShaderVariant& variant)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+        variant.program->release();
+
+        Slot& slot = readbacks[next];
+        f->glReadBuffer(GL_COLOR_ATTACHMENT0);
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        f->glReadPixels(wanted.x(), wanted.y(), 1, 1, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.busy = true;
+        next = (next + 1) % SlotCount;
+        requested = false;
+
+        f->glDisable(GL_SCISSOR_TEST);
+        QOpenGLFramebufferObject::bindDefault();
+    }
+
+    // Delivers every finished readback, oldest first, without waiting.
+    void poll()
+    {
+        if (!framebuffer)
+            return;
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+        for (int i = 0; i < SlotCount; ++i)
+        {
+            Slot& slot = readbacks[(next + i) % SlotCount];
+            if (!slot.busy)
+                continue;
+            const GLenum state = f->glClientWaitSync(slot.fence, 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+                return;
+
+            f->glDeleteSync(slot.fence);
+            slot.busy = false;
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            const GLuint* ids = static_cast<const GLuint*>(f->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 2 * sizeof(GLuint), GL_MAP_READ_BIT));
+            if (ids)
+            {
+                const int object = int(ids[0]) - 1;
+                const int triangle = object < 0 ? -1 : int(ids[1]);
+                f->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                if (object != lastObject || triangle != lastTriangle)
+                {
+                    lastObject = object;
+                    lastTriangle = triangle;
+                    emit picked(object, triangle);
+                }
+            }
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    // Deletes the framebuffer, renderbuffers, pixel buffers and fences. Needs
+    // the context they were created in current.
+    void releaseResources(QOpenGLExtraFunctions* f)
+    {
+        for (Slot& slot : readbacks)
+        {
+            if (slot.busy)
+                f->glDeleteSync(slot.fence);
+            f->glDeleteBuffers(1, &slot.buffer);
+            slot = Slot();
+        }
+        f->glDeleteRenderbuffers(1, &idBuffer);
+        f->glDeleteRenderbuffers(1, &depthBuffer);
+        f->glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = idBuffer = depthBuffer = 0;
+        bufferSize = QSize();
+        requested = false;
+    }
+
+signals:
+    // object is -1 when the cursor is over the background.
+    void picked(int object, int triangle);
+
+private:
+    void ensureResources(QOpenGLExtraFunctions* f, const QSize& size)
+    {
+        if (!framebuffer)
+        {
+            f->glGenFramebuffers(1, &framebuffer);
+            f->glGenRenderbuffers(1, &idBuffer);
+            f->glGenRenderbuffers(1, &depthBuffer);
+            for (Slot& slot : readbacks)
+            {
+                f->glGenBuffers(1, &slot.buffer);
+                f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                f->glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(GLuint), nullptr, GL_STREAM_READ);
+            }
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        if (size == bufferSize)
+            return;
+
+        bufferSize = size;
+        f->glBindRenderbuffer(GL_RENDERBUFFER, idBuffer);
+        f->glRenderbufferStorage(GL_RENDERBUFFER, GL_RG32UI, size.width(), size.height());
+        f->glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        f->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.width(), size.height());
+        f->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        f->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, idBuffer);
+        f->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        if (f->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            qWarning() << "picking framebuffer is incomplete";
+        QOpenGLFramebufferObject::bindDefault();
+    }
+
+    static const int SlotCount = 3;
+
+    struct Slot
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        bool busy = false;
+    };
+
+    GLuint framebuffer = 0;
+    GLuint idBuffer = 0;
+    GLuint depthBuffer = 0;
+    QSize bufferSize;
+    Slot readbacks[SlotCount];
+    int next = 0;
+
+    QPoint wanted;
+    bool requested = false;
+    int lastObject = -1;
+    int lastTriangle = -1;
+};
+
+#endif // GPUPICKER_H
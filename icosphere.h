@@ -21,6 +21,8 @@
 #include <iostream>
 #include <fstream>
 
+#include "meshArena.h"
+
 #if _WIN32
 #include <Windows.h>
 #else
@@ -68,8 +70,14 @@ Vector3 normalize(const Vector3 &a)
 struct Mesh
 {
 public:
-    std::vector<Vector3> vertices;
-    std::vector<uint32_t> triangles;
+    std::vector<Vector3, ArenaAllocator<Vector3>> vertices;
+    std::vector<uint32_t, ArenaAllocator<uint32_t>> triangles;
+
+    explicit Mesh(MeshArena *arena = nullptr)
+        : vertices(ArenaAllocator<Vector3>(arena))
+        , triangles(ArenaAllocator<uint32_t>(arena))
+    {
+    }
 
     uint32_t triangleCount() const { return triangles.size() / 3; }
 
@@ -106,7 +114,16 @@ public:
         triangles.clear();
     }
 
-    double distance(const Vector3 &p, uint32_t tidx) const
+    // Drops the storage as well, which must happen before the arena backing
+    // the mesh is reset.
+    void release()
+    {
+        decltype(vertices)(vertices.get_allocator()).swap(vertices);
+        decltype(triangles)(triangles.get_allocator()).swap(triangles);
+    }
+
+    // Closest point to p on the triangle starting at triangles[tidx].
+    Vector3 closestPoint(const Vector3 &p, uint32_t tidx) const
     {
         const uint32_t idx0 = triangles[tidx];
         const uint32_t idx1 = triangles[tidx + 1];
@@ -223,7 +240,12 @@ public:
             }
         }
 
-        return length(p - (v0 + Vector3(s) * e0 + Vector3(t) * e1));
+        return v0 + Vector3(s) * e0 + Vector3(t) * e1;
+    }
+
+    double distance(const Vector3 &p, uint32_t tidx) const
+    {
+        return length(p - closestPoint(p, tidx));
     }
 
     double distance(const Vector3 &p) const
@@ -295,7 +317,9 @@ struct Edge
     }
 };
 
-uint32_t subdivideEdge(uint32_t f0, uint32_t f1, const Vector3 &v0, const Vector3 &v1, Mesh &io_mesh, std::map<Edge, uint32_t> &io_divisions)
+typedef std::map<Edge, uint32_t, std::less<Edge>, ArenaAllocator<std::pair<const Edge, uint32_t>>> EdgeDivisions;
+
+uint32_t subdivideEdge(uint32_t f0, uint32_t f1, const Vector3 &v0, const Vector3 &v1, Mesh &io_mesh, EdgeDivisions &io_divisions)
 {
     const Edge edge(f0, f1);
     auto it = io_divisions.find(edge);
@@ -311,11 +335,17 @@ uint32_t subdivideEdge(uint32_t f0, uint32_t f1, const Vector3 &v0, const Vector
     return f;
 }
 
-void SubdivideMesh(const Mesh &meshIn, Mesh &meshOut)
+// scratch, when given, holds the temporary edge map. meshOut is sized up front
+// for a closed mesh (one new vertex per edge, 3/2 edges per triangle), so an
+// arena-backed output does not leave abandoned buffers behind as it grows.
+void SubdivideMesh(const Mesh &meshIn, Mesh &meshOut, MeshArena *scratch = nullptr)
 {
-    meshOut.vertices = meshIn.vertices;
+    meshOut.vertices.reserve(meshIn.vertices.size() + meshIn.triangleCount() * 3 / 2);
+    meshOut.triangles.reserve(meshIn.triangles.size() * 4);
+    meshOut.vertices.assign(meshIn.vertices.begin(), meshIn.vertices.end());
+    meshOut.triangles.clear();
 
-    std::map<Edge, uint32_t> divisions; // Edge -> new vertex
+    EdgeDivisions divisions((std::less<Edge>()), ArenaAllocator<std::pair<const Edge, uint32_t>>(scratch)); // Edge -> new vertex
 
     for (uint32_t i = 0; i < meshIn.triangleCount(); ++i)
     {
@@ -0,0 +1,190 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing pool for data-parallel loops.
+//
+// parallelFor() pushes the whole range as one job. Whoever runs a job keeps
+// splitting it in half, pushing the upper half onto its own deque and working
+// on the lower half until it is no bigger than the grain. Owners pop from the
+// back of their deque while idle threads steal from the front, so thieves take
+// the largest remaining pieces. The calling thread takes part in the loop.
+class JobSystem final
+{
+public:
+    typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+    // workerCount threads are started in addition to the calling thread.
+    explicit JobSystem(unsigned workerCount = defaultWorkerCount())
+        : queues(workerCount + 1)
+    {
+        for (auto &queue : queues)
+            queue.reset(new Queue);
+        for (unsigned i = 0; i < workerCount; ++i)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    static unsigned defaultWorkerCount()
+    {
+        const unsigned cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 0;
+    }
+
+    // Threads that execute jobs, including the caller of parallelFor().
+    unsigned threadCount() const { return static_cast<unsigned>(queues.size()); }
+
+    // Runs body over [0, count) in pieces of at most grain elements and
+    // returns once every piece is done. Must not be nested inside a body.
+    void parallelFor(size_t count, size_t grain, const RangeFunction &body)
+    {
+        if (count == 0)
+            return;
+        grain = std::max<size_t>(grain, 1);
+        if (workers.empty() || count <= grain)
+        {
+            body(0, count);
+            return;
+        }
+
+        Loop loop;
+        loop.body = &body;
+        loop.grain = grain;
+        loop.remaining = count;
+
+        const size_t self = queues.size() - 1;
+        push(self, Job{&loop, 0, count});
+        while (loop.remaining.load(std::memory_order_acquire) != 0)
+        {
+            Job job;
+            if (take(self, job))
+                run(self, job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Loop
+    {
+        const RangeFunction *body = nullptr;
+        size_t grain = 1;
+        std::atomic<size_t> remaining{0};
+    };
+
+    struct Job
+    {
+        Loop *loop;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void push(size_t queue, const Job &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+            queues[queue]->jobs.push_back(job);
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wakeUp.notify_one();
+    }
+
+    bool take(size_t self, Job &job)
+    {
+        {
+            Queue &own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = own.jobs.back();
+                own.jobs.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); ++i)
+        {
+            Queue &victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t self, Job job)
+    {
+        while (job.end - job.begin > job.loop->grain)
+        {
+            const size_t middle = job.begin + (job.end - job.begin) / 2;
+            push(self, Job{job.loop, middle, job.end});
+            job.end = middle;
+        }
+        (*job.loop->body)(job.begin, job.end);
+        job.loop->remaining.fetch_sub(job.end - job.begin, std::memory_order_acq_rel);
+    }
+
+    void workerLoop(size_t self)
+    {
+        for (;;)
+        {
+            Job job;
+            if (take(self, job))
+            {
+                run(self, job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<int> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
+
+#endif // JOBSYSTEM_H
@@ -0,0 +1,16 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QLoggingCategory>
+
+// Categories for the application's diagnostics, defined in main.cpp.
+// Statistics gathered along the way are debug messages, off by default; turn
+// them on with QT_LOGGING_RULES, e.g. "qttask.*.debug=true". Output asked for
+// by a key or a command-line option is info and always shown.
+Q_DECLARE_LOGGING_CATEGORY(lcShaders)   // variant compile times
+Q_DECLARE_LOGGING_CATEGORY(lcGeometry)  // meshes, LOD chains, adaptive sphere
+Q_DECLARE_LOGGING_CATEGORY(lcRender)    // per-mode draw and frame statistics
+Q_DECLARE_LOGGING_CATEGORY(lcPacing)    // swap pacing and input latency
+Q_DECLARE_LOGGING_CATEGORY(lcCapture)   // frame capture
+
+#endif // LOGGING_H
@@ -52,42 +52,136 @@
 
 #include <QGuiApplication>
 #include <QMatrix4x4>
+#include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
 #include <QScreen>
 #include <QtMath>
 #include "icosphere.h"
-#include "shaders.h"
-#include "objectAdapter.h"
+#include "shaderCache.h"
+#include "renderTarget.h"
+#include "frameStats.h"
+#include "resolutionController.h"
+#include "gpuPicker.h"
+#include "adaptiveIcosphere.h"
+#include "sceneUpdate.h"
+#include "sdfBaker.h"
+#include "faceIndex.h"
+#include "sceneResources.h"
+#include "multiDrawBatch.h"
+#include "logging.h"
 #include <QKeyEvent>
 #include <QColor>
 #include <QtWidgets>
 #include <QColorDialog>
 
+Q_LOGGING_CATEGORY(lcShaders, "qttask.shaders", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcGeometry, "qttask.geometry", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcRender, "qttask.render", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcPacing, "qttask.pacing", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcCapture, "qttask.capture", QtInfoMsg)
+
 
 //! [1]
 class TriangleWindow : public OpenGLWindow
 {
 public:
-    using OpenGLWindow::OpenGLWindow;
-
     void initialize() override;
     void render() override;
 
-    TriangleWindow():sliderX(&dialog),sliderY(&dialog),sliderZ(&dialog),zBuf(&dialog),colling(&dialog),zBufLabel(QString("Z Buf"),&dialog),collingLabel(QString("Colling"),&dialog)
+    // Geometry, programs and buffers come from resources and are shared with
+    // every other view of it; camera, modes and render targets are per view.
+    explicit TriangleWindow(std::shared_ptr<SceneResources> shared)
+        :resources(std::move(shared)),objects(resources->objects),shaders(resources->shaders),jobs(resources->jobs),scene(jobs),baseVertexBuffer(resources->baseVertexBuffer),baseIndexBuffer(resources->baseIndexBuffer),baseFaces(resources->baseFaces),picker(this),faceIndex(resources->faceIndex),geometry(resources->geometry),sliderX(&dialog),sliderY(&dialog),sliderZ(&dialog),zBuf(&dialog),colling(&dialog),zBufLabel(QString("Z Buf"),&dialog),collingLabel(QString("Colling"),&dialog)
     {
-
+        connect(&picker, &GpuPicker::picked, this, [this](int object, int triangle)
+        {
+            hoveredObject = object;
+            hoveredTriangle = triangle;
+            if (sceneMode && object >= 0)
+                qCDebug(lcRender) << "picked scene object" << object << "triangle" << triangle;
+        });
     }
 
 
     ~TriangleWindow()
     {
+        if (makeCurrent())
+        {
+            picker.releaseResources(this);
+            batch.releaseResources(this);
+            gpuTimer.releaseResources();
+        }
     }
 
     void keyPressEvent(QKeyEvent* key) override;
+    void wheelEvent(QWheelEvent* wheel) override;
+    void mouseMoveEvent(QMouseEvent* mouse) override;
 
+    void setAntiAliasing(AntiAliasing mode) { renderTarget.setMode(mode); }
+
+    // Turns on dynamic resolution with the given frame budget in milliseconds.
+    void setFrameBudget(double milliseconds)
+    {
+        if (milliseconds > 0.0)
+            resolution.budget = milliseconds;
+        dynamicResolution = milliseconds > 0.0;
+    }
+
+    // The LOD chain of Objects that scene mode starts with.
+    void setSceneChain(size_t chain) { sceneChain = chain; }
+
+    // Numbers the view and its control panel. The panel is offset along with
+    // the window so that the panels of several views do not stack.
+    void setViewIndex(int index)
+    {
+        viewIndex = index;
+        setTitle(QStringLiteral("View %1").arg(index + 1));
+        dialog.setWindowTitle(QStringLiteral("View %1 controls").arg(index + 1));
+    }
 
 private:
-    Objects objects;
+    void drawFrame();
+    QMatrix4x4 objectMatrix() const;
+    QMatrix4x4 sceneProjection() const;
+    void applyDepthAndCulling();
+    void renderPicking();
+    void drawHighlight(const ShaderVariant& variant, GLsizei vertexCount);
+    void useLodChain(size_t chain);
+    void setPositions(const ShaderVariant& variant);
+    void renderScene(const QMatrix4x4& projection);
+    void populateMixed(size_t count, float extent);
+    void renderMixed(const QMatrix4x4& projection);
+    SceneUpdate::View sceneView(const QMatrix4x4& projection) const;
+    void renderTessellated(const QMatrix4x4& matrix);
+    void renderTessellatedScene(const QMatrix4x4& projection, float pixelScale);
+    void renderAdaptive();
+    void drawProcedural(const QMatrix4x4& matrix, int level, const QColor& edgeColor, const QColor& fillColor);
+    void benchmarkProcedural(const QMatrix4x4& matrix);
+    void benchmarkFaceIndex();
+
+    std::shared_ptr<SceneResources> resources;
+    Objects& objects;
+    ShaderCache& shaders;
+    JobSystem& jobs;
+    SceneUpdate scene;
+    size_t sceneChain = 0;
+    std::vector<size_t> sceneLevels;
+    std::vector<float> sceneLevelPixels;
+    QOpenGLBuffer& baseVertexBuffer;
+    QOpenGLBuffer& baseIndexBuffer;
+    QOpenGLVertexArrayObject emptyVertexArray;
+    const std::vector<GLint>& baseFaces;
+    ico::AdaptiveSphere adaptiveSphere;
+    RenderTarget renderTarget;
+    FrameStats frameStats;
+    GpuFrameTimer gpuTimer;
+    ResolutionController resolution;
+    GpuPicker picker;
+    const ico::FaceIndex& faceIndex;
+    GeometryArena& geometry;
+    MultiDrawBatch batch;
+    int viewIndex = 0;
     QColorDialog dialog;
     QSlider sliderX;
     QSlider sliderY;
@@ -97,11 +191,44 @@ private:
     QLabel zBufLabel;
     QLabel collingLabel;
 
-    GLint m_posAttr = 0;
-    GLint m_colAttr = 0;
-    GLint m_matrixUniform = 0;
+    bool singlePassWireframe = false;
+    bool quantizedPositions = false;
+    bool sceneMode = false;
+    bool instancingSupported = false;
+    bool scalingRequested = false;
+    bool tessellationMode = false;
+    bool tessellationSupported = false;
+    // The level of the single tessellated sphere. In scene mode each object
+    // gets its own, this many segments per edge at 100 pixels of radius.
+    float tessellationLevel = 4.0f;
+    bool proceduralMode = false;
+    bool proceduralSupported = false;
+    bool benchmarkRequested = false;
+    int proceduralLevel = 2;
+    bool adaptiveMode = false;
+    float cameraDistance = 2.0f;
+    bool dynamicResolution = false;
+    bool pickingSupported = false;
+    int hoveredObject = -1;
+    int hoveredTriangle = -1;
+
+    // The primitive < and > step through, chosen per view.
+    size_t current = 0;
+    bool mixedMode = false;
+    bool multiDrawSupported = false;
+
+    // An object of mixed mode: any primitive, with its own colour and state.
+    struct MixedObject
+    {
+        QVector3D position;
+        QVector3D axis;
+        float speed;
+        float scale;
+        uint32_t primitive;
+        uint32_t key;
+    };
+    std::vector<MixedObject> mixedObjects;
 
-    QOpenGLShaderProgram *m_program = nullptr;
     int m_frame = 0;
 };
 
@@ -109,27 +236,287 @@ void TriangleWindow::keyPressEvent(QKeyEvent* key)
 {
     if (key->key() == Qt::Key_Less)
     {
-        objects.current = objects.current == 0 ? 0 : objects.current-1;
+        current = current == 0 ? 0 : current-1;
     }
     if (key->key() == Qt::Key_Greater)
     {
-        objects.current = objects.current == objects.primitives.size() - 1 ?  objects.primitives.size()-1 : objects.current + 1;
+        current = current == objects.primitives.size() - 1 ?  objects.primitives.size()-1 : current + 1;
+    }
+    if (key->key() == Qt::Key_W)
+    {
+        singlePassWireframe = !singlePassWireframe;
     }
+    if (key->key() == Qt::Key_Q)
+    {
+        quantizedPositions = !quantizedPositions;
+    }
+    if (key->key() == Qt::Key_S)
+    {
+        sceneMode = !sceneMode;
+    }
+    if (key->key() == Qt::Key_G)
+    {
+        mixedMode = !mixedMode;
+    }
+    if (key->key() == Qt::Key_R)
+    {
+        setCapturing(!capturing());
+    }
+    if (key->key() == Qt::Key_C)
+    {
+        useLodChain((sceneChain + 1) % objects.lodChains.size());
+    }
+    if (key->key() == Qt::Key_J)
+    {
+        scalingRequested = true;
+    }
+    if (key->key() == Qt::Key_L)
+    {
+        benchmarkFaceIndex();
+    }
+    if (key->key() == Qt::Key_T)
+    {
+        tessellationMode = !tessellationMode;
+    }
+    if (key->key() == Qt::Key_BracketLeft)
+    {
+        tessellationLevel = std::max(1.0f, tessellationLevel - 0.25f);
+    }
+    if (key->key() == Qt::Key_BracketRight)
+    {
+        tessellationLevel = std::min(64.0f, tessellationLevel + 0.25f);
+    }
+    if (key->key() == Qt::Key_P)
+    {
+        proceduralMode = !proceduralMode;
+    }
+    if (key->key() >= Qt::Key_0 && key->key() <= Qt::Key_8)
+    {
+        proceduralLevel = key->key() - Qt::Key_0;
+    }
+    if (key->key() == Qt::Key_B)
+    {
+        benchmarkRequested = true;
+    }
+    if (key->key() == Qt::Key_A)
+    {
+        adaptiveMode = !adaptiveMode;
+    }
+    if (key->key() == Qt::Key_M)
+    {
+        const AntiAliasing next[] = {AntiAliasing::Msaa2, AntiAliasing::Msaa4, AntiAliasing::Msaa8, AntiAliasing::Fxaa, AntiAliasing::Off};
+        renderTarget.setMode(next[static_cast<int>(renderTarget.antiAliasing())]);
+        frameStats.reset();
+        qCInfo(lcRender) << "aa" << antiAliasingName(renderTarget.antiAliasing());
+    }
+    if (key->key() == Qt::Key_D)
+    {
+        dynamicResolution = !dynamicResolution;
+        resolution.reset();
+        qCInfo(lcRender) << "dynamic resolution" << (dynamicResolution ? "on, budget" : "off,") << resolution.budget << "ms";
+    }
+}
+
+void TriangleWindow::wheelEvent(QWheelEvent* wheel)
+{
+    // Zooming only matters to adaptive mode, which lets the camera come
+    // arbitrarily close to the surface.
+    const float steps = wheel->angleDelta().y() / 120.0f;
+    cameraDistance = 1.0f + (cameraDistance - 1.0f) * std::pow(0.9f, steps);
+    cameraDistance = std::max(1.0001f, std::min(cameraDistance, 50.0f));
+}
+
+void TriangleWindow::mouseMoveEvent(QMouseEvent* mouse)
+{
+    // Window coordinates to render target pixels, origin at the bottom left.
+    const QSize target = renderTarget.renderSize();
+    if (target.isEmpty() || width() == 0 || height() == 0)
+        return;
+    const int x = qBound(0, int(mouse->localPos().x() * target.width() / width()), target.width() - 1);
+    const int y = qBound(0, int(mouse->localPos().y() * target.height() / height()), target.height() - 1);
+    picker.request(QPoint(x, target.height() - 1 - y));
+}
+
+// Bakes a distance field of meshPath, or of an icosphere when it is empty,
+// writes it to outPath and returns the process exit code.
+static int bakeSdf(const QString& outPath, const QString& meshPath, int resolution, double band, const QString& sign)
+{
+    // The mesh, its subdivision scratch and the bake's working lists share
+    // one arena, released on return.
+    ico::MeshArena arena;
+    ico::Mesh mesh(&arena);
+    if (meshPath.isEmpty())
+    {
+        ico::Mesh coarse(&arena);
+        ico::Icosahedron(coarse);
+        for (int level = 0; level < 3; ++level)
+        {
+            ico::SubdivideMesh(coarse, mesh, &arena);
+            std::swap(coarse, mesh);
+        }
+        std::swap(coarse, mesh);
+    }
+    else if (!ico::LoadObj(meshPath.toStdString(), mesh))
+    {
+        qWarning() << "could not read mesh" << meshPath;
+        return 1;
+    }
+
+    ico::SdfSettings settings;
+    settings.band = band;
+    settings.sign = sign == QLatin1String("winding") ? ico::SdfSign::Winding : ico::SdfSign::Normals;
+    const ico::SdfGrid grid = ico::SdfGrid::fit(mesh, uint32_t(std::max(resolution, 8)));
+
+    JobSystem jobs;
+    ico::SdfBakeStats stats;
+    const ico::SdfVolume volume = ico::BakeSdf(mesh, grid, settings, jobs, &stats, &arena);
+    qCInfo(lcGeometry) << "baked" << grid.nx << "x" << grid.ny << "x" << grid.nz << "distance field of" << mesh.triangleCount()
+                       << "triangles in" << stats.seconds * 1000.0 << "ms on" << jobs.threadCount() << "threads:"
+                       << stats.voxelsPerSecond(grid) / 1e6 << "Mvoxels/s," << stats.bakedBricks << "bricks baked,"
+                       << stats.skippedBricks << "skipped";
+
+    if (!volume.write(outPath.toStdString()))
+    {
+        qWarning() << "could not write" << outPath;
+        return 1;
+    }
+    return 0;
 }
 
 int main(int argc, char **argv)
 {
+    // Every window's context shares with the global one, so views can use
+    // each other's buffers and programs.
+    QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption aaOption(QStringLiteral("aa"),
+                                QStringLiteral("Anti-aliasing: off, msaa2, msaa4, msaa8 or fxaa."),
+                                QStringLiteral("mode"), QStringLiteral("msaa4"));
+    parser.addOption(aaOption);
+    QCommandLineOption budgetOption(QStringLiteral("frame-budget"),
+                                    QStringLiteral("Scale the render resolution to hold this frame time, 0 to disable."),
+                                    QStringLiteral("ms"), QStringLiteral("0"));
+    parser.addOption(budgetOption);
+    QCommandLineOption swapIntervalOption(QStringLiteral("swap-interval"),
+                                          QStringLiteral("Refreshes per buffer swap, 0 to disable vsync."),
+                                          QStringLiteral("n"), QStringLiteral("1"));
+    parser.addOption(swapIntervalOption);
+    QCommandLineOption renderAheadOption(QStringLiteral("render-ahead"),
+                                         QStringLiteral("Frames the GPU may lag behind, 0 for no limit."),
+                                         QStringLiteral("frames"), QStringLiteral("2"));
+    parser.addOption(renderAheadOption);
+    QCommandLineOption predictOption(QStringLiteral("predict-late-frames"),
+                                     QStringLiteral("Start frames just in time for the next refresh."));
+    parser.addOption(predictOption);
+    QCommandLineOption latencyOption(QStringLiteral("latency-probe"),
+                                     QStringLiteral("Report input-to-frame latency percentiles."));
+    parser.addOption(latencyOption);
+    QCommandLineOption bakeSdfOption(QStringLiteral("bake-sdf"),
+                                     QStringLiteral("Bake a signed distance field to file and exit."),
+                                     QStringLiteral("file"));
+    parser.addOption(bakeSdfOption);
+    QCommandLineOption sdfMeshOption(QStringLiteral("sdf-mesh"),
+                                     QStringLiteral("OBJ mesh to bake, an icosphere by default."),
+                                     QStringLiteral("obj"));
+    parser.addOption(sdfMeshOption);
+    QCommandLineOption sdfResolutionOption(QStringLiteral("sdf-resolution"),
+                                           QStringLiteral("Distance field voxels along the longest side."),
+                                           QStringLiteral("voxels"), QStringLiteral("128"));
+    parser.addOption(sdfResolutionOption);
+    QCommandLineOption sdfBandOption(QStringLiteral("sdf-band"),
+                                     QStringLiteral("Narrow band width, 0 for a dense field."),
+                                     QStringLiteral("voxels"), QStringLiteral("4"));
+    parser.addOption(sdfBandOption);
+    QCommandLineOption sdfSignOption(QStringLiteral("sdf-sign"),
+                                     QStringLiteral("Inside test: normals or winding."),
+                                     QStringLiteral("mode"), QStringLiteral("normals"));
+    parser.addOption(sdfSignOption);
+    QCommandLineOption meshOption(QStringLiteral("mesh"),
+                                  QStringLiteral("OBJ mesh to show in scene mode, with generated LODs."),
+                                  QStringLiteral("obj"));
+    parser.addOption(meshOption);
+    QCommandLineOption captureOption(QStringLiteral("capture"),
+                                     QStringLiteral("Record frames to file from the start; R toggles recording."),
+                                     QStringLiteral("file"));
+    parser.addOption(captureOption);
+    QCommandLineOption captureFormatOption(QStringLiteral("capture-format"),
+                                           QStringLiteral("Recording format: raw, y4m or png."),
+                                           QStringLiteral("format"), QStringLiteral("y4m"));
+    parser.addOption(captureFormatOption);
+    QCommandLineOption viewsOption(QStringLiteral("views"),
+                                   QStringLiteral("Windows showing the scene, sharing its geometry and programs."),
+                                   QStringLiteral("count"), QStringLiteral("1"));
+    parser.addOption(viewsOption);
+    parser.process(app);
+
+    if (parser.isSet(bakeSdfOption))
+        return bakeSdf(parser.value(bakeSdfOption), parser.value(sdfMeshOption), parser.value(sdfResolutionOption).toInt(),
+                       parser.value(sdfBandOption).toDouble(), parser.value(sdfSignOption));
+
+    PacingSettings pacing;
+    pacing.swapInterval = parser.value(swapIntervalOption).toInt();
+    pacing.renderAhead = parser.value(renderAheadOption).toInt();
+    pacing.predictLateFrames = parser.isSet(predictOption);
+    pacing.latencyProbe = parser.isSet(latencyOption);
+
+    AntiAliasing antiAliasing = AntiAliasing::Msaa4;
+    if (!parseAntiAliasing(parser.value(aaOption), antiAliasing))
+        qWarning() << "unknown anti-aliasing mode" << parser.value(aaOption) << "- using msaa4";
+
+    // Anti-aliasing happens offscreen, so the window itself is single-sampled.
     QSurfaceFormat format;
-    format.setSamples(16);
+    format.setSwapInterval(pacing.swapInterval);
+
+    std::shared_ptr<SceneResources> resources = std::make_shared<SceneResources>();
+    size_t sceneChain = 0;
+    if (parser.isSet(meshOption))
+    {
+        // Imported meshes get a chain of simplified levels for scene mode.
+        ico::Mesh mesh;
+        if (ico::LoadObj(parser.value(meshOption).toStdString(), mesh))
+            sceneChain = resources->objects.addLodChain(mesh, {0.5, 0.25, 0.1, 0.03, 0.01});
+        else
+            qWarning() << "could not read mesh" << parser.value(meshOption);
+    }
+
+    CaptureFormat captureFormat = CaptureFormat::Y4m;
+    if (!parseCaptureFormat(parser.value(captureFormatOption), captureFormat))
+        qWarning() << "unknown capture format" << parser.value(captureFormatOption) << "- using y4m";
+
+    const int views = std::max(1, parser.value(viewsOption).toInt());
+    std::vector<std::unique_ptr<TriangleWindow>> windows;
+    for (int view = 0; view < views; ++view)
+    {
+        windows.emplace_back(new TriangleWindow(resources));
+        TriangleWindow& window = *windows.back();
+        window.setFramePacing(pacing);
+        window.setAntiAliasing(antiAliasing);
+        window.setFrameBudget(parser.value(budgetOption).toDouble());
+        window.setSceneChain(sceneChain);
+        if (views > 1)
+            window.setViewIndex(view);
 
-    TriangleWindow window;
-    window.setFormat(format);
-    window.resize(640, 480);
-    window.show();
+        // Views record to their own file, numbered after the first.
+        QString capturePath = parser.isSet(captureOption) ? parser.value(captureOption)
+                                                          : QStringLiteral("capture.") + captureFormatName(captureFormat);
+        if (view > 0)
+        {
+            const QFileInfo info(capturePath);
+            capturePath = QStringLiteral("%1/%2_view%3.%4").arg(info.path(), info.completeBaseName()).arg(view).arg(info.suffix());
+        }
+        window.setCaptureOutput(capturePath, captureFormat);
+        window.setCapturing(parser.isSet(captureOption));
+        window.setFormat(format);
+        window.resize(640, 480);
+        if (view > 0)
+            window.setPosition(windows.front()->position() + QPoint(view * 40, view * 40));
+        window.show();
 
-    window.setAnimating(true);
+        window.setAnimating(true);
+    }
 
     return app.exec();
 }
@@ -137,7 +524,7 @@ int main(int argc, char **argv)
 void TriangleWindow::initialize()
 {
 
-    dialog.setGeometry(50,50,100,100);
+    dialog.setGeometry(50 + viewIndex * 40, 50 + viewIndex * 40, 100, 100);
     dialog.show();
     dialog.setOption(QColorDialog::NoButtons);
     sliderX.setOrientation(Qt::Orientation::Horizontal);
@@ -153,41 +540,491 @@ void TriangleWindow::initialize()
     zBufLabel.setGeometry(130,260,40,30);
     collingLabel.setGeometry(200,260,40,30);
 
+    // Dynamic resolution goes by the GPU's share of the frame where timer
+    // queries exist and by the CPU submit time alone otherwise.
+    if (!gpuTimer.initialize() && dynamicResolution)
+        qWarning() << "dynamic resolution: no GPU timer queries, scaling by CPU time only";
+
+    // Warm up the variants used by the default two-pass mode; the rest are
+    // built when a key first asks for them.
+    shaders.program(ShaderFeature::None);
+    shaders.program(ShaderFeature::UniformColor);
+
+    // Scene mode draws thousands of spinning copies of one LOD chain, the
+    // icosphere unless a mesh was imported, picking a level per object.
+    instancingSupported = QOpenGLContext::currentContext()->format().version() >= qMakePair(3, 3);
+    useLodChain(sceneChain);
+    scene.populate(20000, 40.0f);
+
+    // Tessellation mode keeps only the 20 base faces on the GPU.
+    tessellationSupported = QOpenGLContext::currentContext()->format().version() >= qMakePair(4, 0);
+    resources->initializeGL(tessellationSupported);
 
-    m_program = new QOpenGLShaderProgram(this);
-    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
-    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
-    m_program->link();
-    m_posAttr = m_program->attributeLocation("posAttr");
-    Q_ASSERT(m_posAttr != -1);
-    m_colAttr = m_program->attributeLocation("colAttr");
-    Q_ASSERT(m_colAttr != -1);
-    m_matrixUniform = m_program->uniformLocation("matrix");
-    Q_ASSERT(m_matrixUniform != -1);
+    // Procedural mode draws with no buffers at all; the empty vertex array
+    // object only keeps core profiles happy.
+    proceduralSupported = QOpenGLContext::currentContext()->format().version() >= qMakePair(3, 0);
+    if (proceduralSupported)
+        emptyVertexArray.create();
+
+    pickingSupported = QOpenGLContext::currentContext()->format().version() >= qMakePair(3, 2);
+
+    // Mixed mode draws every primitive at once from the shared arena, a few
+    // calls per colour and state instead of one per object.
+    multiDrawSupported = instancingSupported && batch.initialize(QOpenGLContext::currentContext());
+    if (multiDrawSupported)
+        qCDebug(lcRender) << "mixed mode draws" << (batch.indirect() ? "with multi-draw indirect" : "instanced per mesh");
+    populateMixed(4000, 30.0f);
 }
 
-void TriangleWindow::render()
+void TriangleWindow::drawProcedural(const QMatrix4x4& matrix, int level, const QColor& edgeColor, const QColor& fillColor)
+{
+    const ShaderVariant& variant = shaders.program(ShaderFeature::Procedural | ShaderFeature::UniformColor);
+    variant.program->bind();
+    variant.program->setUniformValue(variant.matrixUniform, matrix);
+    variant.program->setUniformValue(variant.levelUniform, level);
+    variant.program->setUniformValueArray(variant.baseVerticesUniform, objects.baseVertices.data(), 12, 3);
+    variant.program->setUniformValueArray(variant.baseFacesUniform, baseFaces.data(), baseFaces.size());
+
+    const GLsizei vertexCount = 60 << (2 * level);
+    QOpenGLVertexArrayObject::Binder binder(&emptyVertexArray);
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    variant.program->setUniformValue(variant.colorUniform, edgeColor);
+    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    variant.program->setUniformValue(variant.colorUniform, fillColor);
+    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+
+    variant.program->release();
+}
+
+void TriangleWindow::useLodChain(size_t chain)
+{
+    sceneChain = chain;
+    sceneLevels = objects.lodChains[chain].primitives;
+    sceneLevelPixels = objects.lodChains[chain].lodPixels;
+    scene.setLevels(sceneLevelPixels, 1.0f);
+    qCDebug(lcGeometry) << "scene LOD chain" << chain << ":" << sceneLevels.size() << "levels";
+}
+
+// Compares the bufferless path with the stored-mesh path for levels 0-8.
+// Stored memory is what Objects keeps per level (positions and edge colours);
+// times are per frame, both passes, averaged over a few glFinish'ed frames.
+void TriangleWindow::benchmarkProcedural(const QMatrix4x4& matrix)
+{
+    const int frames = 10;
+    const QColor edgeColor = QColor::fromRgbF(0.1, 0.3, 0.1);
+    const QColor fillColor = dialog.currentColor();
+
+    ico::Mesh mesh;
+    ico::Icosahedron(mesh);
+    for (int level = 0; level <= 8; ++level)
+    {
+        if (level > 0)
+        {
+            ico::Mesh next;
+            ico::SubdivideMesh(mesh, next);
+            std::swap(mesh, next);
+        }
+
+        std::vector<GLfloat> positions(mesh.triangles.size() * 3);
+        for (size_t i = 0; i < mesh.triangles.size(); ++i)
+        {
+            positions[i*3] = mesh.vertices[mesh.triangles[i]].x;
+            positions[i*3+1] = mesh.vertices[mesh.triangles[i]].y;
+            positions[i*3+2] = mesh.vertices[mesh.triangles[i]].z;
+        }
+        const GLsizei vertexCount = mesh.triangles.size();
+
+        const ShaderVariant& stored = shaders.program(ShaderFeature::UniformColor);
+        QElapsedTimer timer;
+        glFinish();
+        timer.start();
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            stored.program->bind();
+            stored.program->setUniformValue(stored.matrixUniform, matrix);
+            glVertexAttribPointer(stored.posAttr, 3, GL_FLOAT, GL_FALSE, 0, positions.data());
+            glEnableVertexAttribArray(stored.posAttr);
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            stored.program->setUniformValue(stored.colorUniform, edgeColor);
+            glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            stored.program->setUniformValue(stored.colorUniform, fillColor);
+            glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+            glDisableVertexAttribArray(stored.posAttr);
+            stored.program->release();
+            glFinish();
+        }
+        const double storedMs = timer.nsecsElapsed() / 1e6 / frames;
+
+        timer.restart();
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            drawProcedural(matrix, level, edgeColor, fillColor);
+            glFinish();
+        }
+        const double proceduralMs = timer.nsecsElapsed() / 1e6 / frames;
+
+        const size_t storedBytes = positions.size() * 2 * sizeof(GLfloat);
+        qCInfo(lcRender) << "level" << level << ":" << mesh.triangleCount() << "triangles,"
+                         << "stored" << storedBytes << "bytes" << storedMs << "ms,"
+                         << "procedural" << baseFaces.size() * sizeof(GLint) + objects.baseVertices.size() * sizeof(GLfloat)
+                         << "bytes" << proceduralMs << "ms";
+    }
+}
+
+void TriangleWindow::benchmarkFaceIndex()
+{
+    const size_t count = 1 << 20;
+    std::mt19937 random(1);
+    std::normal_distribution<float> gaussian;
+    std::vector<float> directions(count * 3);
+    for (float& value : directions)
+        value = gaussian(random);
+    std::vector<ico::FaceIndex::FaceId> faces(count);
+
+    for (uint32_t level : {4u, 8u, 12u, 16u})
+    {
+        QElapsedTimer timer;
+        timer.start();
+        faceIndex.locate(directions.data(), count, level, faces.data(), jobs);
+        const qint64 ns = std::max<qint64>(timer.nsecsElapsed(), 1);
+        qCInfo(lcGeometry) << "face index level" << level << ":" << count << "directions in" << ns / 1e6 << "ms,"
+                           << count * 1e3 / ns << "Mpoints/s on" << jobs.threadCount() << "threads";
+    }
+}
+
+void TriangleWindow::renderAdaptive()
+{
+    const float aspect = 4.0f / 3.0f;
+    QMatrix4x4 model;
+    model.rotate(100.0f * m_frame / screen()->refreshRate(), sliderX.value(), sliderY.value(), sliderZ.value());
+    QMatrix4x4 matrix;
+    matrix.perspective(60.0f, aspect, std::max(1e-5f, (cameraDistance - 1.0f) * 0.5f), cameraDistance + 2.0f);
+    matrix.translate(0, 0, -cameraDistance);
+    matrix *= model;
+
+    const QVector3D camera = model.inverted().map(QVector3D(0, 0, cameraDistance));
+    ico::AdaptiveSphere::View view;
+    view.viewProjection = matrix.constData();
+    view.cameraX = camera.x();
+    view.cameraY = camera.y();
+    view.cameraZ = camera.z();
+    view.viewportWidth = renderTarget.renderSize().width();
+    view.viewportHeight = renderTarget.renderSize().height();
+    view.pixelScale = view.viewportHeight / (2.0f * std::tan(qDegreesToRadians(30.0f)));
+    if (adaptiveSphere.update(view) && m_frame % 60 == 0)
+        qCDebug(lcGeometry) << "adaptive sphere:" << adaptiveSphere.triangleCount() << "triangles";
+
+    const ShaderVariant& variant = shaders.program(ShaderFeature::UniformColor);
+    variant.program->bind();
+    variant.program->setUniformValue(variant.matrixUniform, matrix);
+    glVertexAttribPointer(variant.posAttr, 3, GL_FLOAT, GL_FALSE, 0, adaptiveSphere.positions.data());
+    glEnableVertexAttribArray(variant.posAttr);
+
+    const GLsizei vertexCount = adaptiveSphere.positions.size() / 3;
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    variant.program->setUniformValue(variant.colorUniform, QColor::fromRgbF(0.1, 0.3, 0.1));
+    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    variant.program->setUniformValue(variant.colorUniform, dialog.currentColor());
+    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+
+    glDisableVertexAttribArray(variant.posAttr);
+    variant.program->release();
+}
+
+void TriangleWindow::renderTessellated(const QMatrix4x4& matrix)
+{
+    const ShaderVariant& variant = shaders.program(ShaderFeature::Tessellation);
+    variant.program->bind();
+    variant.program->setUniformValue(variant.matrixUniform, matrix);
+    variant.program->setUniformValue(variant.tessLevelUniform, tessellationLevel);
+
+    // Patches default to three vertices, one base face each.
+    baseVertexBuffer.bind();
+    baseIndexBuffer.bind();
+    glVertexAttribPointer(variant.posAttr, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(variant.posAttr);
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    variant.program->setUniformValue(variant.colorUniform, QColor::fromRgbF(0.1, 0.3, 0.1));
+    glDrawElements(GL_PATCHES, objects.baseIndices.size(), GL_UNSIGNED_INT, nullptr);
+
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    variant.program->setUniformValue(variant.colorUniform, dialog.currentColor());
+    glDrawElements(GL_PATCHES, objects.baseIndices.size(), GL_UNSIGNED_INT, nullptr);
+
+    glDisableVertexAttribArray(variant.posAttr);
+    baseIndexBuffer.release();
+    baseVertexBuffer.release();
+    variant.program->release();
+}
+
+void TriangleWindow::renderTessellatedScene(const QMatrix4x4& projection, float pixelScale)
 {
-    objects.setColor(dialog.currentColor());
+    const ShaderVariant& variant = shaders.program(ShaderFeature::Tessellation | ShaderFeature::Instancing);
+    variant.program->bind();
+    variant.program->setUniformValue(variant.matrixUniform, projection);
+    variant.program->setUniformValue(variant.tessLevelUniform, tessellationLevel * pixelScale / 100.0f);
+
+    // Positions come from the base buffer, instance matrices from client
+    // memory, so the vertex buffer is released before pointing at them.
+    baseVertexBuffer.bind();
+    glVertexAttribPointer(variant.posAttr, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    baseVertexBuffer.release();
+    baseIndexBuffer.bind();
+    glEnableVertexAttribArray(variant.posAttr);
+    for (GLint column = 0; column < 4; ++column)
+    {
+        glEnableVertexAttribArray(variant.instanceAttr + column);
+        glVertexAttribDivisor(variant.instanceAttr + column, 1);
+    }
+
+    const std::pair<GLenum, QColor> passes[] = {{GL_LINE, QColor::fromRgbF(0.1, 0.3, 0.1)}, {GL_FILL, dialog.currentColor()}};
+    for (const auto& pass : passes)
+    {
+        if (pass.first == GL_FILL)
+            glEnable(GL_POLYGON_OFFSET_FILL);
+        else
+            glDisable(GL_POLYGON_OFFSET_FILL);
+        glPolygonMode(GL_FRONT_AND_BACK, pass.first);
+        variant.program->setUniformValue(variant.colorUniform, pass.second);
+        for (size_t level = 0; level < sceneLevels.size(); ++level)
+        {
+            if (scene.instanceCounts[level] == 0)
+                continue;
+            const GLfloat* instances = scene.instances[level].data();
+            for (GLint column = 0; column < 4; ++column)
+                glVertexAttribPointer(variant.instanceAttr + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), instances + column * 4);
+            glDrawElementsInstanced(GL_PATCHES, objects.baseIndices.size(), GL_UNSIGNED_INT, nullptr, scene.instanceCounts[level]);
+        }
+    }
+
+    for (GLint column = 0; column < 4; ++column)
+    {
+        glVertexAttribDivisor(variant.instanceAttr + column, 0);
+        glDisableVertexAttribArray(variant.instanceAttr + column);
+    }
+    glDisableVertexAttribArray(variant.posAttr);
+    baseIndexBuffer.release();
+    variant.program->release();
+}
+
+SceneUpdate::View TriangleWindow::sceneView(const QMatrix4x4& projection) const
+{
+    SceneUpdate::View view;
+    view.viewProjection = projection.constData();
+    view.pixelScale = renderTarget.renderSize().height() / (2.0f * std::tan(qDegreesToRadians(30.0f)));
+    view.time = m_frame / screen()->refreshRate();
+    return view;
+}
 
+void TriangleWindow::renderScene(const QMatrix4x4& projection)
+{
+    const SceneUpdate::View view = sceneView(projection);
+    scene.update(view);
+
+    if (m_frame % 300 == 0)
+        qCDebug(lcRender) << "scene update:" << scene.visibleCount() << "/" << scene.objectCount() << "visible,"
+                          << "compose" << scene.timings.compose << "ms,"
+                          << "cull+lod" << scene.timings.cull << "ms,"
+                          << "compact" << scene.timings.compact << "ms on" << jobs.threadCount() << "threads";
+
+    if (scalingRequested)
+    {
+        scalingRequested = false;
+        for (const ScalingSample& sample : measureSceneScaling(scene.objectCount(), view, sceneLevelPixels, 1.0f))
+            qCInfo(lcRender) << sample.threads << "threads:" << sample.timings.total() << "ms"
+                             << "(compose" << sample.timings.compose << "cull+lod" << sample.timings.cull
+                             << "compact" << sample.timings.compact << ")";
+    }
+
+    // Icosphere scenes can skip the stored levels and tessellate every object
+    // from the base faces instead.
+    if (tessellationMode && tessellationSupported && sceneChain == 0)
+    {
+        renderTessellatedScene(projection, view.pixelScale);
+        return;
+    }
+
+    const ShaderVariant& variant = shaders.program(ShaderFeature::UniformColor | ShaderFeature::Instancing | ShaderFeature::Wireframe);
+    variant.program->bind();
+    variant.program->setUniformValue(variant.matrixUniform, projection);
+    variant.program->setUniformValue(variant.colorUniform, dialog.currentColor());
+    variant.program->setUniformValue(variant.edgeColorUniform, QColor::fromRgbF(0.1, 0.3, 0.1));
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    glEnableVertexAttribArray(variant.posAttr);
+    glEnableVertexAttribArray(variant.baryAttr);
+    for (GLint column = 0; column < 4; ++column)
+    {
+        glEnableVertexAttribArray(variant.instanceAttr + column);
+        glVertexAttribDivisor(variant.instanceAttr + column, 1);
+    }
+
+    for (size_t level = 0; level < sceneLevels.size(); ++level)
+    {
+        if (scene.instanceCounts[level] == 0)
+            continue;
 
+        const size_t primitive = sceneLevels[level];
+        const GLfloat* instances = scene.instances[level].data();
+        glVertexAttribPointer(variant.posAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.primitives[primitive]);
+        glVertexAttribPointer(variant.baryAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.barycentrics.data());
+        for (GLint column = 0; column < 4; ++column)
+            glVertexAttribPointer(variant.instanceAttr + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), instances + column * 4);
+
+        glDrawArraysInstanced(GL_TRIANGLES, 0, objects.primitiveSize[primitive]/3, scene.instanceCounts[level]);
+    }
+
+    for (GLint column = 0; column < 4; ++column)
+    {
+        glVertexAttribDivisor(variant.instanceAttr + column, 0);
+        glDisableVertexAttribArray(variant.instanceAttr + column);
+    }
+    glDisableVertexAttribArray(variant.baryAttr);
+    glDisableVertexAttribArray(variant.posAttr);
+
+    variant.program->release();
+}
+
+void TriangleWindow::populateMixed(size_t count, float extent)
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<uint32_t> primitive(0, uint32_t(objects.primitives.size() - 1));
+    std::uniform_int_distribution<uint32_t> color(0, 3);
+    std::uniform_int_distribution<uint32_t> state(0, 3);
+
+    mixedObjects.resize(count);
+    for (MixedObject& object : mixedObjects)
+    {
+        object.position = QVector3D(unit(random), unit(random), unit(random)) * extent;
+        object.axis = QVector3D(unit(random), unit(random), unit(random)).normalized();
+        object.speed = 90.0f * unit(random);
+        object.scale = 0.5f + 0.5f * std::fabs(unit(random));
+        object.primitive = primitive(random);
+        object.key = MultiDrawBatch::key(ShaderFeature::UniformColor | ShaderFeature::Instancing, color(random),
+                                         state(random) & (MultiDrawBatch::Wireframe | MultiDrawBatch::Cull));
+    }
+}
+
+void TriangleWindow::renderMixed(const QMatrix4x4& projection)
+{
+    const float time = m_frame / screen()->refreshRate();
+    QMatrix4x4 viewProjection = projection;
+    viewProjection.translate(0, 0, -60.0f);
+    viewProjection.rotate(10.0f * time, 0, 1, 0);
+
+    batch.clear();
+    QMatrix4x4 model;
+    for (const MixedObject& object : mixedObjects)
+    {
+        model.setToIdentity();
+        model.translate(object.position);
+        model.rotate(object.speed * time, object.axis);
+        model.scale(object.scale);
+        batch.add(object.key, object.primitive, model);
+    }
+
+    const std::vector<QColor> palette = {dialog.currentColor(), QColor::fromRgbF(0.1, 0.3, 0.1),
+                                         QColor(Qt::darkCyan), QColor(Qt::darkRed)};
+    batch.submit(this, shaders, geometry, viewProjection, palette);
+
+    if (m_frame % 300 == 0)
+    {
+        const MultiDrawBatch::Stats& stats = batch.lastStats();
+        qCDebug(lcRender) << "mixed:" << stats.records << "objects in" << stats.buckets << "buckets,"
+                          << stats.commands << "commands," << stats.drawCalls << "draw calls,"
+                          << stats.stateChanges << "state changes,"
+                          << geometry.rangeCount() << "meshes in" << geometry.bytes() << "arena bytes";
+    }
+}
+
+void TriangleWindow::setPositions(const ShaderVariant& variant)
+{
+    if (variant.posScaleUniform != -1)
+    {
+        const GLshort* positions = objects.quantized(current);
+        variant.program->setUniformValue(variant.posScaleUniform, objects.quantizedScales[current]);
+        glVertexAttribPointer(variant.posAttr, 3, GL_SHORT, GL_TRUE, 0, positions);
+    }
+    else
+        glVertexAttribPointer(variant.posAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.primitives[current]);
+}
+
+void TriangleWindow::render()
+{
+    frameStats.frameStarted();
+    gpuTimer.poll();
+    gpuTimer.begin();
 
-    const qreal retinaScale = devicePixelRatio();
-    glViewport(0, 0, width() * retinaScale, height() * retinaScale);
+    // The render cost, not the frame interval: with vsync the interval is
+    // rounded up to whole refreshes whatever the load. CPU and GPU overlap,
+    // so the slower of the two bounds the frame.
+    const double renderCost = std::max(frameStats.lastSubmitTime(), gpuTimer.lastFrameTime());
+    renderTarget.setScale(dynamicResolution ? resolution.update(renderCost) : 1.0);
+
+    const QSize pixelSize = size() * devicePixelRatio();
+    renderTarget.begin(pixelSize);
 
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-    m_program->bind();
+    drawFrame();
+
+    renderTarget.resolve(pixelSize, shaders);
+
+    if (pickingSupported)
+    {
+        picker.poll();
+        if (picker.pending())
+            renderPicking();
+    }
+
+    gpuTimer.end();
+    frameStats.frameFinished();
+
+    if (frameStats.frameCount() > 0 && frameStats.frameCount() % 300 == 0)
+        qCDebug(lcRender) << "aa" << antiAliasingName(renderTarget.antiAliasing()) << ":"
+                          << frameStats.frameInterval() << "ms per frame,"
+                          << frameStats.submitTime() << "ms to submit,"
+                          << renderTarget.memoryBytes() << "bytes offscreen,"
+                          << "render scale" << renderTarget.renderScale();
+    ++m_frame;
+}
 
+QMatrix4x4 TriangleWindow::objectMatrix() const
+{
     QMatrix4x4 matrix;
     matrix.perspective(60.0f, 4.0f / 3.0f, 0.1f, 100.0f);
     matrix.translate(0, 0, -2);
     matrix.rotate(100.0f * m_frame / screen()->refreshRate(), sliderX.value(), sliderY.value(), sliderZ.value());
+    return matrix;
+}
 
-    m_program->setUniformValue(m_matrixUniform, matrix);
-
-
+QMatrix4x4 TriangleWindow::sceneProjection() const
+{
+    QMatrix4x4 projection;
+    projection.perspective(60.0f, 4.0f / 3.0f, 0.1f, 200.0f);
+    return projection;
+}
 
+void TriangleWindow::applyDepthAndCulling()
+{
     if (zBuf.checkState() == Qt::CheckState::Checked)
         glEnable(GL_DEPTH_TEST);
     else
@@ -200,42 +1037,192 @@ void TriangleWindow::render()
     }
         else
         glDisable(GL_CULL_FACE);
+}
+
+// The ID pass mirrors what drawFrame() drew for the modes that support
+// picking: the current primitive, or the instanced scene.
+void TriangleWindow::renderPicking()
+{
+    const bool instanced = sceneMode && instancingSupported;
+    if (!instanced && (mixedMode || adaptiveMode || proceduralMode || tessellationMode))
+        return;
+
+    const ShaderVariant& variant = picker.begin(renderTarget.renderSize(), shaders, instanced);
+    applyDepthAndCulling();
+    glEnable(GL_DEPTH_TEST);
+
+    glEnableVertexAttribArray(variant.posAttr);
+    if (!instanced)
+    {
+        variant.program->setUniformValue(variant.matrixUniform, objectMatrix());
+        variant.program->setUniformValue(variant.objectIdUniform, int(current));
+        glVertexAttribPointer(variant.posAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.primitives[current]);
+        glDrawArrays(GL_TRIANGLES, 0, objects.primitiveSize[current]/3);
+    }
+    else
+    {
+        variant.program->setUniformValue(variant.matrixUniform, sceneProjection());
+        glEnableVertexAttribArray(variant.objectAttr);
+        glVertexAttribDivisor(variant.objectAttr, 1);
+        for (GLint column = 0; column < 4; ++column)
+        {
+            glEnableVertexAttribArray(variant.instanceAttr + column);
+            glVertexAttribDivisor(variant.instanceAttr + column, 1);
+        }
+
+        for (size_t level = 0; level < sceneLevels.size(); ++level)
+        {
+            if (scene.instanceCounts[level] == 0)
+                continue;
+            const size_t primitive = sceneLevels[level];
+            const GLfloat* instances = scene.instances[level].data();
+            glVertexAttribPointer(variant.posAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.primitives[primitive]);
+            glVertexAttribIPointer(variant.objectAttr, 1, GL_UNSIGNED_INT, 0, scene.instanceObjects[level].data());
+            for (GLint column = 0; column < 4; ++column)
+                glVertexAttribPointer(variant.instanceAttr + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), instances + column * 4);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, objects.primitiveSize[primitive]/3, scene.instanceCounts[level]);
+        }
+
+        for (GLint column = 0; column < 4; ++column)
+        {
+            glVertexAttribDivisor(variant.instanceAttr + column, 0);
+            glDisableVertexAttribArray(variant.instanceAttr + column);
+        }
+        glVertexAttribDivisor(variant.objectAttr, 0);
+        glDisableVertexAttribArray(variant.objectAttr);
+    }
+    glDisableVertexAttribArray(variant.posAttr);
+
+    picker.end(variant);
+}
+
+// Redraws the hovered triangle of the current primitive on top of the fill,
+// with the bound program and positions.
+void TriangleWindow::drawHighlight(const ShaderVariant& variant, GLsizei vertexCount)
+{
+    if (hoveredObject != int(current) || hoveredTriangle < 0 || hoveredTriangle * 3 >= vertexCount)
+        return;
+    variant.program->setUniformValue(variant.colorUniform, QColor(Qt::yellow));
+    glDepthFunc(GL_LEQUAL);
+    glDrawArrays(GL_TRIANGLES, hoveredTriangle * 3, 3);
+    glDepthFunc(GL_LESS);
+}
+
+void TriangleWindow::drawFrame()
+{
+    const QMatrix4x4 matrix = objectMatrix();
+
+    applyDepthAndCulling();
+
+    if (sceneMode && instancingSupported)
+    {
+        renderScene(sceneProjection());
+        return;
+    }
+
+    if (mixedMode && multiDrawSupported)
+    {
+        renderMixed(sceneProjection());
+        return;
+    }
+
+    if (adaptiveMode)
+    {
+        renderAdaptive();
+        return;
+    }
+
+    if (proceduralMode && proceduralSupported)
+    {
+        if (benchmarkRequested)
+        {
+            benchmarkRequested = false;
+            benchmarkProcedural(matrix);
+        }
+        drawProcedural(matrix, proceduralLevel, QColor::fromRgbF(0.1, 0.3, 0.1), dialog.currentColor());
+        return;
+    }
+
+    if (tessellationMode && tessellationSupported)
+    {
+        renderTessellated(matrix);
+        return;
+    }
+
+    const unsigned positionFeature = quantizedPositions ? ShaderFeature::Quantized : ShaderFeature::None;
+    const GLsizei vertexCount = objects.primitiveSize[current]/3;
+    const QColor fillColor = dialog.currentColor();
+    const QColor edgeColor = QColor::fromRgbF(0.1, 0.3, 0.1);
+
+    if (singlePassWireframe)
+    {
+        const ShaderVariant& variant = shaders.program(ShaderFeature::UniformColor | ShaderFeature::Wireframe | positionFeature);
+        variant.program->bind();
+        variant.program->setUniformValue(variant.matrixUniform, matrix);
+        variant.program->setUniformValue(variant.colorUniform, fillColor);
+        variant.program->setUniformValue(variant.edgeColorUniform, edgeColor);
+
+        setPositions(variant);
+        glVertexAttribPointer(variant.baryAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.barycentrics.data());
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        glEnableVertexAttribArray(variant.posAttr);
+        glEnableVertexAttribArray(variant.baryAttr);
+
+        glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+        drawHighlight(variant, vertexCount);
+
+        glDisableVertexAttribArray(variant.baryAttr);
+        glDisableVertexAttribArray(variant.posAttr);
+
+        variant.program->release();
+        return;
+    }
 
     /////////////////////////////////////////////////////
 
-    glVertexAttribPointer(m_posAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.primitives[objects.current]);
-    glVertexAttribPointer(m_colAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.edgeColors[objects.current]);
+    const ShaderVariant& edges = shaders.program(positionFeature);
+    edges.program->bind();
+    edges.program->setUniformValue(edges.matrixUniform, matrix);
+
+    setPositions(edges);
+    glVertexAttribPointer(edges.colAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.edgeColors[current]);
 
     glDisable(GL_POLYGON_OFFSET_FILL);
-    glEnableVertexAttribArray(m_posAttr);
-    glEnableVertexAttribArray(m_colAttr);
+    glEnableVertexAttribArray(edges.posAttr);
+    glEnableVertexAttribArray(edges.colAttr);
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    glDrawArrays(GL_TRIANGLES, 0 , objects.primitiveSize[objects.current]/3);
+    glDrawArrays(GL_TRIANGLES, 0 , vertexCount);
 
-    glDisableVertexAttribArray(m_colAttr);
-    glDisableVertexAttribArray(m_posAttr);
+    glDisableVertexAttribArray(edges.colAttr);
+    glDisableVertexAttribArray(edges.posAttr);
+    edges.program->release();
     /////////////////////////////////////////////////////
 
+     // The fill colour comes from the dialog as a uniform instead of being
+     // written into every vertex of the current primitive each frame.
+     const ShaderVariant& fill = shaders.program(ShaderFeature::UniformColor | positionFeature);
+     fill.program->bind();
+     fill.program->setUniformValue(fill.matrixUniform, matrix);
+     fill.program->setUniformValue(fill.colorUniform, fillColor);
 
-     glVertexAttribPointer(m_posAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.primitives[objects.current]);
-     glVertexAttribPointer(m_colAttr, 3, GL_FLOAT, GL_FALSE, 0, objects.fillColors[objects.current]);
+     setPositions(fill);
 
      glEnable(GL_POLYGON_OFFSET_FILL);
      //glPolygonOffset(1.0f, 1.0f);
 
      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-     glEnableVertexAttribArray(m_posAttr);
-     glEnableVertexAttribArray(m_colAttr);
+     glEnableVertexAttribArray(fill.posAttr);
 
-     glDrawArrays(GL_TRIANGLES, 0, objects.primitiveSize[objects.current]/3);
+     glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+     drawHighlight(fill, vertexCount);
 
-     glDisableVertexAttribArray(m_colAttr);
-     glDisableVertexAttribArray(m_posAttr);
+     glDisableVertexAttribArray(fill.posAttr);
 
-
-    m_program->release();
-    ++m_frame;
+    fill.program->release();
 }
 //! [5]
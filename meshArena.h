@@ -0,0 +1,157 @@
+#ifndef MESHARENA_H
+#define MESHARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace ico
+{
+
+// Running total of the bytes held by a group of arenas and its high-water mark.
+struct MemoryCounter
+{
+    size_t current = 0;
+    size_t peak = 0;
+
+    void add(size_t bytes)
+    {
+        current += bytes;
+        peak = std::max(peak, current);
+    }
+
+    void remove(size_t bytes) { current -= bytes; }
+};
+
+// Bump allocator for geometry. Memory is handed out from large blocks and only
+// returned as a whole by reset() or destruction, so building a mesh costs a few
+// block allocations instead of one per container growth.
+class MeshArena final
+{
+public:
+    explicit MeshArena(MemoryCounter *counter = nullptr, size_t blockSize = 1 << 20)
+        : counter(counter), blockSize(blockSize)
+    {
+    }
+
+    ~MeshArena() { releaseBlocks(0); }
+
+    MeshArena(const MeshArena &) = delete;
+    MeshArena &operator=(const MeshArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        if (!blocks.empty())
+        {
+            Block &block = blocks.back();
+            const size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+            if (offset + bytes <= block.size)
+            {
+                used += offset + bytes - block.used;
+                block.used = offset + bytes;
+                return block.data.get() + offset;
+            }
+        }
+
+        Block block;
+        block.size = std::max(blockSize, bytes + alignment);
+        block.data.reset(new char[block.size]);
+        const size_t offset = static_cast<size_t>(-reinterpret_cast<uintptr_t>(block.data.get()) & (alignment - 1));
+        block.used = offset + bytes;
+        used += block.used;
+        reserved += block.size;
+        if (counter)
+            counter->add(block.size);
+        blocks.push_back(std::move(block));
+        return blocks.back().data.get() + offset;
+    }
+
+    template <typename T>
+    T *allocate(size_t count)
+    {
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Forgets every allocation. The largest block is kept for reuse; nothing
+    // allocated from the arena may be touched afterwards.
+    void reset()
+    {
+        if (blocks.empty())
+            return;
+        std::sort(blocks.begin(), blocks.end(), [](const Block &a, const Block &b) { return a.size > b.size; });
+        releaseBlocks(1);
+        blocks.front().used = 0;
+        used = 0;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return reserved; }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+        size_t used = 0;
+    };
+
+    void releaseBlocks(size_t keep)
+    {
+        while (blocks.size() > keep)
+        {
+            reserved -= blocks.back().size;
+            if (counter)
+                counter->remove(blocks.back().size);
+            blocks.pop_back();
+        }
+    }
+
+    MemoryCounter *counter;
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t used = 0;
+    size_t reserved = 0;
+};
+
+// Standard allocator over a MeshArena, so containers can live in it. Without an
+// arena it falls back to the global heap.
+template <typename T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    MeshArena *arena = nullptr;
+
+    ArenaAllocator() = default;
+    explicit ArenaAllocator(MeshArena *arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count)
+    {
+        if (arena)
+            return arena->allocate<T>(count);
+        return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T *pointer, size_t)
+    {
+        if (!arena)
+            ::operator delete(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}
+
+#endif // MESHARENA_H
@@ -0,0 +1,470 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+#include "icosphere.h"
+
+namespace ico
+{
+
+// Garland-Heckbert quadric: the weighted sum of squared distances to a set
+// of planes, kept as the upper triangle of a symmetric 4x4 matrix, plus the
+// total weight of the face planes.
+struct Quadric
+{
+    double a[10] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    double area = 0.0;
+
+    // Plane n.p + d = 0 with unit n, weighted.
+    static Quadric plane(const Vector3 &n, double d, double weight)
+    {
+        Quadric q;
+        q.a[0] = n.x * n.x * weight; q.a[1] = n.x * n.y * weight; q.a[2] = n.x * n.z * weight; q.a[3] = n.x * d * weight;
+        q.a[4] = n.y * n.y * weight; q.a[5] = n.y * n.z * weight; q.a[6] = n.y * d * weight;
+        q.a[7] = n.z * n.z * weight; q.a[8] = n.z * d * weight;
+        q.a[9] = d * d * weight;
+        return q;
+    }
+
+    Quadric &operator +=(const Quadric &other)
+    {
+        for (int i = 0; i < 10; ++i)
+            a[i] += other.a[i];
+        area += other.area;
+        return *this;
+    }
+
+    double error(const Vector3 &p) const
+    {
+        return a[0] * p.x * p.x + 2.0 * a[1] * p.x * p.y + 2.0 * a[2] * p.x * p.z + 2.0 * a[3] * p.x
+             + a[4] * p.y * p.y + 2.0 * a[5] * p.y * p.z + 2.0 * a[6] * p.y
+             + a[7] * p.z * p.z + 2.0 * a[8] * p.z
+             + a[9];
+    }
+
+    // The point of least error, if the quadric pins one down.
+    bool minimum(Vector3 &p) const
+    {
+        const double c00 = a[4] * a[7] - a[5] * a[5];
+        const double c01 = a[2] * a[5] - a[1] * a[7];
+        const double c02 = a[1] * a[5] - a[2] * a[4];
+        const double det = a[0] * c00 + a[1] * c01 + a[2] * c02;
+        const double scale = a[0] + a[4] + a[7];
+        if (std::fabs(det) <= 1e-12 * scale * scale * scale)
+            return false;
+
+        const double c11 = a[0] * a[7] - a[2] * a[2];
+        const double c12 = a[1] * a[2] - a[0] * a[5];
+        const double c22 = a[0] * a[4] - a[1] * a[1];
+        const double inv = -1.0 / det;
+        p = Vector3((c00 * a[3] + c01 * a[6] + c02 * a[8]) * inv,
+                    (c01 * a[3] + c11 * a[6] + c12 * a[8]) * inv,
+                    (c02 * a[3] + c12 * a[6] + c22 * a[8]) * inv);
+        return true;
+    }
+};
+
+// Quadric-error edge-collapse simplification.
+//
+// Adjacency is a vertex -> triangle table in one flat array, built once per
+// call to simplify(). Collapsing v into u rewrites v's triangles to use u and
+// chains v's table entry onto u's, so the triangles around a vertex are the
+// entries of every vertex merged into it. Candidate collapses sit in a heap;
+// entries made stale by a nearby collapse are recognised by per-vertex
+// versions and dropped when they surface.
+//
+// Quadrics carry over between calls, so successive simplify() calls build an
+// LOD chain whose error is measured against the original surface. All working
+// data lives in the scratch arena when one is given; it grows with every call
+// and is only returned when the arena is reset.
+class MeshSimplifier final
+{
+public:
+    explicit MeshSimplifier(const Mesh &mesh, MeshArena *scratch = nullptr)
+        : scratch(scratch)
+        , positions(mesh.vertices.begin(), mesh.vertices.end(), ArenaAllocator<Vector3>(scratch))
+        , corners(mesh.triangles.begin(), mesh.triangles.end(), ArenaAllocator<uint32_t>(scratch))
+        , quadrics(mesh.vertices.size(), Quadric(), ArenaAllocator<Quadric>(scratch))
+        , adjacencyStart(ArenaAllocator<uint32_t>(scratch))
+        , adjacency(ArenaAllocator<uint32_t>(scratch))
+        , version(ArenaAllocator<uint32_t>(scratch))
+        , removed(ArenaAllocator<uint8_t>(scratch))
+        , chainNext(ArenaAllocator<uint32_t>(scratch))
+        , chainTail(ArenaAllocator<uint32_t>(scratch))
+        , dead(ArenaAllocator<uint8_t>(scratch))
+        , onBorder(ArenaAllocator<uint8_t>(scratch))
+        , neighboursU(ArenaAllocator<uint32_t>(scratch))
+        , neighboursV(ArenaAllocator<uint32_t>(scratch))
+    {
+        buildAdjacency();
+
+        // Face planes weighted by area, and a stiff plane through every
+        // border edge, square to the face, to keep open borders in place.
+        for (uint32_t t = 0; t < triangleCount(); ++t)
+        {
+            const uint32_t *c = &corners[t * 3];
+            const Vector3 n = cross(positions[c[1]] - positions[c[0]], positions[c[2]] - positions[c[0]]);
+            const double area2 = length(n);
+            if (area2 <= 0.0)
+                continue;
+            const Vector3 unit = Vector3(1.0 / area2) * n;
+            Quadric face = Quadric::plane(unit, -dot(unit, positions[c[0]]), area2 * 0.5);
+            face.area = area2 * 0.5;
+            for (int k = 0; k < 3; ++k)
+                quadrics[c[k]] += face;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t from = c[k], to = c[(k + 1) % 3];
+                if (!isBorder(from, to))
+                    continue;
+                const Vector3 edge = positions[to] - positions[from];
+                const Vector3 side = cross(edge, unit);
+                const double sideLength = length(side);
+                if (sideLength <= 0.0)
+                    continue;
+                const Vector3 m = Vector3(1.0 / sideLength) * side;
+                const Quadric border = Quadric::plane(m, -dot(m, positions[from]), BorderWeight * dot(edge, edge));
+                quadrics[from] += border;
+                quadrics[to] += border;
+            }
+        }
+    }
+
+    uint32_t triangleCount() const { return uint32_t(corners.size() / 3); }
+
+    // Largest RMS distance to the merged planes of any collapse so far, in
+    // mesh units.
+    double error() const { return std::sqrt(maxError); }
+
+    // Collapses edges, cheapest first, until at most targetTriangles remain
+    // or no collapse keeps the mesh manifold and unflipped. Returns the
+    // triangle count reached.
+    uint32_t simplify(uint32_t targetTriangles)
+    {
+        uint32_t alive = triangleCount();
+        if (alive <= targetTriangles)
+            return alive;
+
+        const uint32_t vertexCount = uint32_t(positions.size());
+        version.assign(vertexCount, 0);
+        removed.assign(vertexCount, 0);
+        chainNext.assign(vertexCount, None);
+        chainTail.resize(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            chainTail[v] = v;
+        dead.assign(triangleCount(), 0);
+        onBorder.assign(vertexCount, 0);
+
+        CandidateHeap heap((std::less<Candidate>()), ArenaVector<Candidate>(ArenaAllocator<Candidate>(scratch)));
+        for (uint32_t t = 0; t < triangleCount(); ++t)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t from = corners[t * 3 + k], to = corners[t * 3 + (k + 1) % 3];
+                const bool border = isBorder(from, to);
+                if (border)
+                    onBorder[from] = onBorder[to] = 1;
+                if (from < to || border)
+                    push(heap, from, to);
+            }
+        }
+
+        ArenaVector<uint32_t> ring((ArenaAllocator<uint32_t>(scratch)));
+        while (alive > targetTriangles && !heap.empty())
+        {
+            const Candidate top = heap.top();
+            heap.pop();
+            if (removed[top.u] || removed[top.v] || version[top.u] != top.versionU || version[top.v] != top.versionV)
+                continue;
+            double cost = 0.0;
+            const Vector3 target = collapseTarget(top.u, top.v, cost);
+            if (!canCollapse(top.u, top.v, target))
+                continue;
+
+            // Keep u, retire v.
+            const uint32_t u = top.u, v = top.v;
+            forEachTriangle(v, [&](uint32_t t)
+            {
+                uint32_t *c = &corners[t * 3];
+                if (c[0] == u || c[1] == u || c[2] == u)
+                {
+                    dead[t] = 1;
+                    --alive;
+                    return;
+                }
+                for (int k = 0; k < 3; ++k)
+                    if (c[k] == v)
+                        c[k] = u;
+            });
+            chainNext[chainTail[u]] = v;
+            chainTail[u] = chainTail[v];
+            removed[v] = 1;
+            onBorder[u] |= onBorder[v];
+
+            positions[u] = target;
+            quadrics[u] += quadrics[v];
+            ++version[u];
+            if (quadrics[u].area > 0.0)
+                maxError = std::max(maxError, cost / quadrics[u].area);
+
+            ring.clear();
+            forEachTriangle(u, [&](uint32_t t)
+            {
+                for (int k = 0; k < 3; ++k)
+                    if (corners[t * 3 + k] != u)
+                        ring.push_back(corners[t * 3 + k]);
+            });
+            std::sort(ring.begin(), ring.end());
+            ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+            for (uint32_t w : ring)
+                push(heap, u, w);
+        }
+
+        compact();
+        return triangleCount();
+    }
+
+    void mesh(Mesh &out) const
+    {
+        out.vertices.assign(positions.begin(), positions.end());
+        out.triangles.assign(corners.begin(), corners.end());
+    }
+
+private:
+    enum : uint32_t { None = 0xffffffffu };
+    static constexpr double BorderWeight = 1000.0;
+
+    struct Candidate
+    {
+        float cost;
+        uint32_t u, v;
+        uint32_t versionU, versionV;
+
+        bool operator <(const Candidate &other) const { return cost > other.cost; }
+    };
+    typedef std::priority_queue<Candidate, ArenaVector<Candidate>> CandidateHeap;
+
+    void buildAdjacency()
+    {
+        const size_t vertexCount = positions.size();
+        adjacencyStart.assign(vertexCount + 1, 0);
+        for (uint32_t c : corners)
+            ++adjacencyStart[c + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        adjacency.resize(corners.size());
+        ArenaVector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1, ArenaAllocator<uint32_t>(scratch));
+        for (uint32_t i = 0; i < corners.size(); ++i)
+            adjacency[fill[corners[i]]++] = i / 3;
+    }
+
+    // Before simplify() starts, a directed edge is a border edge when no
+    // triangle runs along it the other way.
+    bool isBorder(uint32_t from, uint32_t to) const
+    {
+        for (uint32_t i = adjacencyStart[to]; i < adjacencyStart[to + 1]; ++i)
+        {
+            const uint32_t *c = &corners[adjacency[i] * 3];
+            for (int k = 0; k < 3; ++k)
+                if (c[k] == to && c[(k + 1) % 3] == from)
+                    return false;
+        }
+        return true;
+    }
+
+    template <typename F>
+    void forEachTriangle(uint32_t vertex, F f)
+    {
+        for (uint32_t w = vertex; w != None; w = chainNext[w])
+            for (uint32_t i = adjacencyStart[w]; i < adjacencyStart[w + 1]; ++i)
+                if (!dead[adjacency[i]])
+                    f(adjacency[i]);
+    }
+
+    // Where u and v would merge to, and the error of putting them there.
+    // Recomputed when a candidate surfaces rather than stored in the heap.
+    Vector3 collapseTarget(uint32_t u, uint32_t v, double &cost) const
+    {
+        Quadric q = quadrics[u];
+        q += quadrics[v];
+
+        Vector3 target(0.0);
+        if (!q.minimum(target))
+        {
+            const Vector3 middle = Vector3(0.5) * (positions[u] + positions[v]);
+            const double eu = q.error(positions[u]), ev = q.error(positions[v]), em = q.error(middle);
+            target = eu <= ev && eu <= em ? positions[u] : (ev <= em ? positions[v] : middle);
+        }
+        cost = std::max(q.error(target), 0.0);
+        return target;
+    }
+
+    void push(CandidateHeap &heap, uint32_t u, uint32_t v)
+    {
+        double cost = 0.0;
+        collapseTarget(u, v, cost);
+        heap.push(Candidate{float(cost), u, v, version[u], version[v]});
+    }
+
+    // Rejects collapses that would pinch the surface (the two ends share a
+    // neighbour other than across the edge, or an interior edge joins two
+    // border vertices) or flip a surviving triangle.
+    bool canCollapse(uint32_t u, uint32_t v, const Vector3 &target)
+    {
+        neighboursU.clear();
+        neighboursV.clear();
+        uint32_t shared = 0;
+        bool ok = true;
+        forEachTriangle(u, [&](uint32_t t)
+        {
+            const uint32_t *c = &corners[t * 3];
+            for (int k = 0; k < 3; ++k)
+                if (c[k] != u)
+                    neighboursU.push_back(c[k]);
+            if (c[0] == v || c[1] == v || c[2] == v)
+                ++shared;
+        });
+        if (shared > 1 && onBorder[u] && onBorder[v])
+            return false;
+        const auto checkFlips = [&](uint32_t moving, uint32_t other)
+        {
+            forEachTriangle(moving, [&](uint32_t t)
+            {
+                const uint32_t *c = &corners[t * 3];
+                if (!ok || c[0] == other || c[1] == other || c[2] == other)
+                    return;
+                Vector3 p[3] = {positions[c[0]], positions[c[1]], positions[c[2]]};
+                const Vector3 before = cross(p[1] - p[0], p[2] - p[0]);
+                for (int k = 0; k < 3; ++k)
+                    if (c[k] == moving)
+                        p[k] = target;
+                const Vector3 after = cross(p[1] - p[0], p[2] - p[0]);
+                if (dot(before, after) <= 0.0)
+                    ok = false;
+            });
+        };
+        checkFlips(u, v);
+        if (!ok)
+            return false;
+        checkFlips(v, u);
+        if (!ok)
+            return false;
+
+        forEachTriangle(v, [&](uint32_t t)
+        {
+            const uint32_t *c = &corners[t * 3];
+            for (int k = 0; k < 3; ++k)
+                if (c[k] != v)
+                    neighboursV.push_back(c[k]);
+        });
+        std::sort(neighboursU.begin(), neighboursU.end());
+        neighboursU.erase(std::unique(neighboursU.begin(), neighboursU.end()), neighboursU.end());
+        std::sort(neighboursV.begin(), neighboursV.end());
+        neighboursV.erase(std::unique(neighboursV.begin(), neighboursV.end()), neighboursV.end());
+
+        uint32_t common = 0;
+        for (size_t i = 0, j = 0; i < neighboursU.size() && j < neighboursV.size();)
+        {
+            if (neighboursU[i] < neighboursV[j])
+                ++i;
+            else if (neighboursV[j] < neighboursU[i])
+                ++j;
+            else
+            {
+                ++common;
+                ++i;
+                ++j;
+            }
+        }
+        return shared > 0 && common == shared;
+    }
+
+    // Drops dead triangles and unused vertices and rebuilds the adjacency
+    // for the next call.
+    void compact()
+    {
+        ArenaVector<uint32_t> remap(positions.size(), None, ArenaAllocator<uint32_t>(scratch));
+        ArenaVector<Vector3> keptPositions((ArenaAllocator<Vector3>(scratch)));
+        ArenaVector<Quadric> keptQuadrics((ArenaAllocator<Quadric>(scratch)));
+        ArenaVector<uint32_t> keptCorners((ArenaAllocator<uint32_t>(scratch)));
+        keptPositions.reserve(positions.size());
+        keptQuadrics.reserve(positions.size());
+        keptCorners.reserve(corners.size());
+        for (uint32_t t = 0; t < triangleCount(); ++t)
+        {
+            if (dead[t])
+                continue;
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t c = corners[t * 3 + k];
+                if (remap[c] == None)
+                {
+                    remap[c] = uint32_t(keptPositions.size());
+                    keptPositions.push_back(positions[c]);
+                    keptQuadrics.push_back(quadrics[c]);
+                }
+                keptCorners.push_back(remap[c]);
+            }
+        }
+        positions.swap(keptPositions);
+        quadrics.swap(keptQuadrics);
+        corners.swap(keptCorners);
+        buildAdjacency();
+    }
+
+    MeshArena *scratch;
+
+    ArenaVector<Vector3> positions;
+    ArenaVector<uint32_t> corners;
+    ArenaVector<Quadric> quadrics;
+    double maxError = 0.0;
+
+    ArenaVector<uint32_t> adjacencyStart;
+    ArenaVector<uint32_t> adjacency;
+
+    // Per simplify() call.
+    ArenaVector<uint32_t> version;
+    ArenaVector<uint8_t> removed;
+    ArenaVector<uint32_t> chainNext;
+    ArenaVector<uint32_t> chainTail;
+    ArenaVector<uint8_t> dead;
+    ArenaVector<uint8_t> onBorder;
+    ArenaVector<uint32_t> neighboursU;
+    ArenaVector<uint32_t> neighboursV;
+};
+
+struct LodLevel
+{
+    explicit LodLevel(MeshArena *arena = nullptr) : mesh(arena) {}
+
+    Mesh mesh;
+    double error = 0.0; // largest deviation from the input, roughly, in mesh units
+};
+
+// Simplifies mesh to each of ratios (fractions of its triangle count,
+// decreasing), each level starting from the previous one. The simplifier's
+// working data and the level meshes are allocated from scratch, which has to
+// outlive the returned levels.
+inline std::vector<LodLevel> BuildLodChain(const Mesh &mesh, const std::vector<double> &ratios, MeshArena *scratch = nullptr)
+{
+    std::vector<LodLevel> chain;
+    MeshSimplifier simplifier(mesh, scratch);
+    for (double ratio : ratios)
+    {
+        simplifier.simplify(uint32_t(std::max(1.0, mesh.triangleCount() * ratio)));
+        chain.emplace_back(scratch);
+        simplifier.mesh(chain.back().mesh);
+        chain.back().error = simplifier.error();
+    }
+    return chain;
+}
+
+}
+
+#endif // MESHSIMPLIFIER_H
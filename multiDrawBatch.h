@@ -0,0 +1,297 @@
+#ifndef MULTIDRAWBATCH_H
+#define MULTIDRAWBATCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <QColor>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include "geometryArena.h"
+#include "shaderCache.h"
+
+// Draws many objects made of GeometryArena ranges in a few API calls.
+//
+// Each frame the caller adds one record per object: a state key, the range
+// and the object's matrix. submit() sorts the records by key and range,
+// writes the matrices into one instance buffer in that order, and turns every
+// run of records sharing a range into one instanced command. Each key becomes
+// one bucket. It gets a program bind, its state changes, and then a single
+// glMultiDrawElementsIndirect over its commands, with baseInstance locating
+// the matrices. Without indirect drawing, or without baseInstance (GL 4.2 or
+// ARB_base_instance), every command is a glDrawElementsInstancedBaseVertex
+// instead, which is still one call per
+// distinct mesh rather than per object.
+class MultiDrawBatch final
+{
+public:
+    // Key layout, most significant first so that sorting groups by program,
+    // then colour, then fixed-function state.
+    enum : uint32_t
+    {
+        Wireframe   = 1u << 0,
+        Cull        = 1u << 1,
+        ColorShift  = 8,
+        ProgramShift = 16
+    };
+
+    static uint32_t key(unsigned programFeatures, uint32_t color, uint32_t state)
+    {
+        return (uint32_t(programFeatures) << ProgramShift) | (color << ColorShift) | state;
+    }
+
+    struct Stats
+    {
+        size_t records = 0;
+        size_t buckets = 0;
+        size_t commands = 0;
+        size_t drawCalls = 0;
+        size_t stateChanges = 0; // program binds, colour uniforms, polygon mode and culling
+    };
+
+    // Resolves the entry points. Needs the view's context current.
+    bool initialize(QOpenGLContext* context)
+    {
+        // Commands find their matrices through baseInstance, which has to be
+        // honoured; without it every command would read the first ones.
+        const bool desktop = !context->isOpenGLES();
+        const bool multiDraw = (desktop && context->format().version() >= qMakePair(4, 3))
+                               || context->hasExtension(QByteArrayLiteral("GL_ARB_multi_draw_indirect"));
+        const bool baseInstance = (desktop && context->format().version() >= qMakePair(4, 2))
+                                  || context->hasExtension(QByteArrayLiteral("GL_ARB_base_instance"));
+        if (multiDraw && baseInstance)
+            multiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirect>(context->getProcAddress("glMultiDrawElementsIndirect"));
+        drawElementsInstancedBaseVertex = reinterpret_cast<DrawElementsInstancedBaseVertex>(context->getProcAddress("glDrawElementsInstancedBaseVertex"));
+
+        instanceBuffer.create();
+        instanceBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+        // QOpenGLBuffer has no indirect target.
+        if (multiDrawElementsIndirect)
+            context->extraFunctions()->glGenBuffers(1, &indirectBuffer);
+        return supported();
+    }
+
+    // Deletes the buffers. Needs the context initialize() ran in current.
+    void releaseResources(QOpenGLExtraFunctions* f)
+    {
+        instanceBuffer.destroy();
+        instanceCapacity = 0;
+        if (indirectBuffer)
+            f->glDeleteBuffers(1, &indirectBuffer);
+        indirectBuffer = 0;
+        multiDrawElementsIndirect = nullptr;
+        drawElementsInstancedBaseVertex = nullptr;
+    }
+
+    bool supported() const { return multiDrawElementsIndirect || drawElementsInstancedBaseVertex; }
+    bool indirect() const { return multiDrawElementsIndirect != nullptr; }
+
+    void clear() { records.clear(); }
+
+    void add(uint32_t key, uint32_t range, const QMatrix4x4& matrix)
+    {
+        Record record;
+        record.key = key;
+        record.range = range;
+        std::memcpy(record.matrix, matrix.constData(), sizeof(record.matrix));
+        records.push_back(record);
+    }
+
+    // Draws everything added since clear(). palette maps the colour field of
+    // the keys to the colour uniform.
+    void submit(QOpenGLExtraFunctions* f, ShaderCache& shaders, GeometryArena& arena,
+                const QMatrix4x4& viewProjection, const std::vector<QColor>& palette)
+    {
+        stats = Stats();
+        stats.records = records.size();
+        if (records.empty() || !supported())
+            return;
+
+        std::sort(records.begin(), records.end(), [](const Record& a, const Record& b)
+        {
+            return a.key != b.key ? a.key < b.key : a.range < b.range;
+        });
+
+        // Matrices in draw order, and one command per run of equal key and
+        // range.
+        instances.resize(records.size() * 16);
+        commands.clear();
+        buckets.clear();
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            std::memcpy(&instances[i * 16], records[i].matrix, sizeof(records[i].matrix));
+            const bool newBucket = i == 0 || records[i].key != records[i - 1].key;
+            if (newBucket)
+                buckets.push_back(Bucket{records[i].key, commands.size(), 0});
+            if (newBucket || records[i].range != records[i - 1].range)
+            {
+                const GeometryArena::Range& range = arena.range(records[i].range);
+                commands.push_back(Command{GLuint(range.indexCount), 0, range.firstIndex, range.baseVertex, GLuint(i)});
+                ++buckets.back().commandCount;
+            }
+            ++commands.back().instanceCount;
+        }
+        stats.buckets = buckets.size();
+        stats.commands = commands.size();
+
+        instanceBuffer.bind();
+        if (instances.size() * sizeof(GLfloat) > instanceCapacity)
+        {
+            instanceCapacity = std::max(instances.size() * sizeof(GLfloat), instanceCapacity * 2);
+            instanceBuffer.allocate(int(instanceCapacity));
+        }
+        instanceBuffer.write(0, instances.data(), int(instances.size() * sizeof(GLfloat)));
+        instanceBuffer.release();
+        if (indirect())
+        {
+            f->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            f->glBufferData(GL_DRAW_INDIRECT_BUFFER, GLsizeiptr(commands.size() * sizeof(Command)), commands.data(), GL_STREAM_DRAW);
+        }
+
+        const ShaderVariant* variant = nullptr;
+        uint32_t state = ~0u;
+        for (const Bucket& bucket : buckets)
+        {
+            const unsigned features = bucket.key >> ProgramShift;
+            if (!variant || features != (state >> ProgramShift))
+            {
+                if (variant)
+                    unbind(f, *variant);
+                variant = &shaders.program(features);
+                bind(f, *variant, arena, viewProjection);
+                ++stats.stateChanges;
+            }
+
+            const uint32_t color = (bucket.key >> ColorShift) & 0xff;
+            if (color < palette.size())
+            {
+                variant->program->setUniformValue(variant->colorUniform, palette[color]);
+                ++stats.stateChanges;
+            }
+            if (state == ~0u || ((bucket.key ^ state) & Wireframe))
+            {
+                glPolygonMode(GL_FRONT_AND_BACK, bucket.key & Wireframe ? GL_LINE : GL_FILL);
+                ++stats.stateChanges;
+            }
+            if (state == ~0u || ((bucket.key ^ state) & Cull))
+            {
+                if (bucket.key & Cull)
+                    f->glEnable(GL_CULL_FACE);
+                else
+                    f->glDisable(GL_CULL_FACE);
+                ++stats.stateChanges;
+            }
+            state = bucket.key;
+
+            if (indirect())
+            {
+                multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                          reinterpret_cast<const void*>(bucket.firstCommand * sizeof(Command)),
+                                          GLsizei(bucket.commandCount), 0);
+                ++stats.drawCalls;
+                continue;
+            }
+
+            // No baseInstance: point the instance attribute at each command's
+            // matrices before drawing it.
+            for (size_t c = bucket.firstCommand; c < bucket.firstCommand + bucket.commandCount; ++c)
+            {
+                const Command& command = commands[c];
+                pointInstances(f, *variant, command.baseInstance);
+                drawElementsInstancedBaseVertex(GL_TRIANGLES, GLsizei(command.count), GL_UNSIGNED_INT,
+                                                reinterpret_cast<const void*>(command.firstIndex * sizeof(GLuint)),
+                                                GLsizei(command.instanceCount), command.baseVertex);
+                ++stats.drawCalls;
+            }
+        }
+
+        if (variant)
+            unbind(f, *variant);
+        arena.release();
+        if (indirect())
+            f->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    }
+
+    const Stats& lastStats() const { return stats; }
+
+private:
+    // The layout glMultiDrawElementsIndirect reads.
+    struct Command
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct Record
+    {
+        uint32_t key;
+        uint32_t range;
+        GLfloat matrix[16];
+    };
+
+    struct Bucket
+    {
+        uint32_t key;
+        size_t firstCommand;
+        size_t commandCount;
+    };
+
+    typedef void (QOPENGLF_APIENTRYP MultiDrawElementsIndirect)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+    typedef void (QOPENGLF_APIENTRYP DrawElementsInstancedBaseVertex)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount, GLint baseVertex);
+
+    void bind(QOpenGLExtraFunctions* f, const ShaderVariant& variant, GeometryArena& arena, const QMatrix4x4& viewProjection)
+    {
+        variant.program->bind();
+        variant.program->setUniformValue(variant.matrixUniform, viewProjection);
+        f->glEnableVertexAttribArray(variant.posAttr);
+        arena.bind(f, variant.posAttr);
+        for (GLint column = 0; column < 4; ++column)
+        {
+            f->glEnableVertexAttribArray(variant.instanceAttr + column);
+            f->glVertexAttribDivisor(variant.instanceAttr + column, 1);
+        }
+        pointInstances(f, variant, 0);
+    }
+
+    void unbind(QOpenGLExtraFunctions* f, const ShaderVariant& variant)
+    {
+        for (GLint column = 0; column < 4; ++column)
+        {
+            f->glVertexAttribDivisor(variant.instanceAttr + column, 0);
+            f->glDisableVertexAttribArray(variant.instanceAttr + column);
+        }
+        f->glDisableVertexAttribArray(variant.posAttr);
+        variant.program->release();
+    }
+
+    void pointInstances(QOpenGLExtraFunctions* f, const ShaderVariant& variant, GLuint firstInstance)
+    {
+        instanceBuffer.bind();
+        for (GLint column = 0; column < 4; ++column)
+            f->glVertexAttribPointer(variant.instanceAttr + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+                                     reinterpret_cast<const void*>((firstInstance * 16 + column * 4) * sizeof(GLfloat)));
+        instanceBuffer.release();
+    }
+
+    MultiDrawElementsIndirect multiDrawElementsIndirect = nullptr;
+    DrawElementsInstancedBaseVertex drawElementsInstancedBaseVertex = nullptr;
+
+    std::vector<Record> records;
+    std::vector<GLfloat> instances;
+    std::vector<Command> commands;
+    std::vector<Bucket> buckets;
+    Stats stats;
+
+    QOpenGLBuffer instanceBuffer{QOpenGLBuffer::VertexBuffer};
+    size_t instanceCapacity = 0;
+    GLuint indirectBuffer = 0;
+};
+
+#endif // MULTIDRAWBATCH_H
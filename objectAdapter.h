@@ -1,8 +1,6 @@
 #ifndef OBJECTADAPTER_H
 #define OBJECTADAPTER_H
 
-#endif // OBJECTADAPTER_H
-
 #include <vector>
 
 
@@ -13,28 +11,51 @@
 #include <QScreen>
 #include <QtMath>
 #include <QColor>
+#include <QDebug>
+#include <QElapsedTimer>
 #include "cube.h"
+#include "logging.h"
 #include "icosphere.h"
+#include "meshSimplifier.h"
 
 
 class Objects final
 {
 public:
+    // Primitives that draw the same shape at decreasing detail, finest first,
+    // with the smallest projected radius in pixels that still selects each.
+    struct LodChain
+    {
+        std::vector<size_t> primitives;
+        std::vector<float> lodPixels;
+    };
+
     std::vector<size_t> primitiveSize;
     std::vector<GLfloat*> primitives;
-    std::vector<GLfloat*> fillColors;
     std::vector<GLfloat*> edgeColors;
+    std::vector<GLshort*> quantizedPrimitives;
+    std::vector<GLfloat> quantizedScales;
+
+    // The indexed base icosahedron, for paths that refine it on the GPU.
+    std::vector<GLfloat> baseVertices;
+    std::vector<GLuint> baseIndices;
+
+    // One barycentric corner per vertex, long enough for the largest primitive.
+    std::vector<GLfloat> barycentrics;
 
-    size_t current = 0;
+    // Bytes of the block holding each primitive's streams, and the most memory
+    // held by all arenas at once while the primitives were generated.
+    std::vector<size_t> primitiveBytes;
+    size_t peakGenerationBytes = 0;
+
+    // lodChains[0] is the icosphere.
+    std::vector<LodChain> lodChains;
 
     Objects()
     {
         float cubeSize = 1;
         Cube cube;
-        primitiveSize.push_back(cube.vertex.size()*3);
-        primitives.push_back( new GLfloat[ primitiveSize[0]]);
-        fillColors.push_back( new GLfloat[ primitiveSize[0]]);
-        edgeColors.push_back( new GLfloat[ primitiveSize[0]]);
+        addPrimitive(cube.vertex.size()*3);
 
         for(size_t i = 0; i< primitiveSize[0]/3; ++i)
         {
@@ -43,76 +64,180 @@ public:
             primitives[0][i*3+2] = cube.vertex[i].coordinates[2] * cubeSize - cubeSize/2;
         }
 
-        for(size_t i = 0; i < primitiveSize[0]/3; ++i)
+        // Two scratch arenas take turns holding the current and the next
+        // level, so only two levels and one edge map are ever alive.
+        ico::MeshArena scratchA(&memory), scratchB(&memory);
+        ico::MeshArena* scratch[2] = { &scratchA, &scratchB };
+        ico::Mesh meshes[2] = { ico::Mesh(scratch[0]), ico::Mesh(scratch[1]) };
+        ico::Icosahedron(meshes[0]);
+        for (const ico::Vector3& v : meshes[0].vertices)
         {
-            fillColors.back()[i*3] =     0.1f;
-            fillColors.back()[i*3+1] =   0.5f + 0.5f / static_cast<double>(primitiveSize[0]) * i;
-            fillColors.back()[i*3+2] =   0.1f;
+            baseVertices.push_back(v.x);
+            baseVertices.push_back(v.y);
+            baseVertices.push_back(v.z);
         }
+        baseIndices.assign(meshes[0].triangles.begin(), meshes[0].triangles.end());
 
-        for(size_t i = 0; i < primitiveSize[0]/3; ++i)
-        {
-            edgeColors.back()[i*3] =     0.1f;
-            edgeColors.back()[i*3+1] =   0.3f;
-            edgeColors.back()[i*3+2] =   0.1f;
-        }
-
-
-        ico::Mesh m;
-        ico::Icosahedron(m);
         for (size_t j = 0; j<3; ++j)
         {
-            primitiveSize.push_back(m.triangles.size()*3);
-            primitives.push_back( new GLfloat[ primitiveSize[j+1]]);
-            fillColors.push_back( new GLfloat[ primitiveSize[j+1]]);
-             edgeColors.push_back( new GLfloat[ primitiveSize[j+1]]);
-            for(size_t i = 0; i< primitiveSize[j+1]/3; ++i)
+            const ico::Mesh& m = meshes[j%2];
+            GLfloat* positions = addPrimitive(m.triangles.size()*3);
+            for(size_t i = 0; i< m.triangles.size(); ++i)
             {
-                primitives[j+1][i*3] = m.vertices[m.triangles[i]].x;
-                primitives[j+1][i*3+1] = m.vertices[m.triangles[i]].y;
-                primitives[j+1][i*3+2] = m.vertices[m.triangles[i]].z;
+                positions[i*3] = m.vertices[m.triangles[i]].x;
+                positions[i*3+1] = m.vertices[m.triangles[i]].y;
+                positions[i*3+2] = m.vertices[m.triangles[i]].z;
             }
 
-            for(size_t i = 0; i < primitiveSize[j+1]/3; ++i)
+            if (j+1 != 3)
             {
-                fillColors[j+1][i*3] =     0.1f;
-                fillColors[j+1][i*3+1] =   0.5f + 0.5f / static_cast<double>(m.triangles.size()) * i;
-                fillColors[j+1][i*3+2] =   0.1f;
+                ico::Mesh& next = meshes[(j+1)%2];
+                next.release();
+                scratch[(j+1)%2]->reset();
+                ico::SubdivideMesh(m, next, scratch[(j+1)%2]);
             }
+        }
+        peakGenerationBytes = memory.peak;
+        lodChains.push_back(LodChain{{3, 2, 1}, {60.0f, 20.0f, 0.0f}});
 
-            for(size_t i = 0; i < primitiveSize[j+1]/3; ++i)
-            {
-                edgeColors[j+1][i*3] =     0.1f;
-                edgeColors[j+1][i*3+1] =   0.3f;
-                edgeColors[j+1][i*3+2] =   0.1f;
-            }
+        updateSharedStreams();
 
-            ico::Mesh m2 = m;
-            if (j+1 != 3)
-                ico::SubdivideMesh(m2, m);
+#if PRINT_STATS
+        for (size_t i = 0; i < primitives.size(); ++i)
+            qCDebug(lcGeometry) << "primitive" << i << ":" << primitiveSize[i]/9 << "triangles," << primitiveBytes[i] << "bytes";
+        qCDebug(lcGeometry) << "geometry storage" << storage.bytesReserved() << "bytes, peak during generation" << peakGenerationBytes << "bytes";
+#endif
+    }
+
+    // Positions of primitive i as normalized shorts, built on first request.
+    // The shader multiplies them back by quantizedScales[i].
+    const GLshort* quantized(size_t i)
+    {
+        if (quantizedPrimitives[i])
+            return quantizedPrimitives[i];
+
+        GLfloat scale = 0.0f;
+        for (size_t k = 0; k < primitiveSize[i]; ++k)
+            scale = std::max(scale, std::fabs(primitives[i][k]));
+        if (scale == 0.0f)
+            scale = 1.0f;
+
+        quantizedPrimitives[i] = storage.allocate<GLshort>(primitiveSize[i]);
+        for (size_t k = 0; k < primitiveSize[i]; ++k)
+            quantizedPrimitives[i][k] = static_cast<GLshort>(std::lround(primitives[i][k] / scale * 32767.0f));
+        quantizedScales[i] = scale;
+        primitiveBytes[i] += primitiveSize[i] * sizeof(GLshort);
+        return quantizedPrimitives[i];
+    }
+
+    size_t storageBytes() const { return storage.bytesReserved(); }
+
+    // Adds mesh and its simplifications to ratios of its triangle count as a
+    // new LOD chain, and returns the chain's index. The mesh is centred and
+    // scaled into the unit sphere, like the icosphere. A level is selected
+    // while its simplification error stays under pixelTolerance on screen.
+    size_t addLodChain(ico::Mesh mesh, const std::vector<double>& ratios, float pixelTolerance = 1.0f)
+    {
+        ico::Vector3 lo(1e30), hi(-1e30);
+        for (const ico::Vector3& v : mesh.vertices)
+        {
+            lo = ico::Vector3(std::fmin(lo.x, v.x), std::fmin(lo.y, v.y), std::fmin(lo.z, v.z));
+            hi = ico::Vector3(std::fmax(hi.x, v.x), std::fmax(hi.y, v.y), std::fmax(hi.z, v.z));
         }
+        const ico::Vector3 centre = ico::Vector3(0.5) * (lo + hi);
+        double radius = 0.0;
+        for (const ico::Vector3& v : mesh.vertices)
+            radius = std::fmax(radius, ico::length(v - centre));
+        const double scale = radius > 0.0 ? 1.0 / radius : 1.0;
+        for (ico::Vector3& v : mesh.vertices)
+            v = ico::Vector3(scale) * (v - centre);
+
+        // The simplifier's working data and the levels only live until the
+        // levels are copied into storage.
+        ico::MeshArena scratch(&memory);
+        QElapsedTimer timer;
+        timer.start();
+        const std::vector<ico::LodLevel> levels = ico::BuildLodChain(mesh, ratios, &scratch);
+        const qint64 buildMs = timer.elapsed();
+
+        LodChain chain;
+        chain.primitives.push_back(addMesh(mesh));
+        for (const ico::LodLevel& level : levels)
+        {
+            chain.primitives.push_back(addMesh(level.mesh));
+
+            // The previous level is good enough until this one's error,
+            // projected at the object's distance, reaches the tolerance.
+            const float pixels = pixelTolerance / float(std::max(level.error, 1e-6));
+            chain.lodPixels.push_back(chain.lodPixels.empty() ? pixels : std::min(chain.lodPixels.back(), pixels));
+        }
+        chain.lodPixels.push_back(0.0f);
+        lodChains.push_back(chain);
+        updateSharedStreams();
+
+#if PRINT_STATS
+        qCDebug(lcGeometry) << "LOD chain" << lodChains.size() - 1 << "built in" << buildMs << "ms:";
+        for (size_t l = 0; l < chain.primitives.size(); ++l)
+            qCDebug(lcGeometry) << "  primitive" << chain.primitives[l] << ":" << primitiveSize[chain.primitives[l]]/9 << "triangles,"
+                                << "selected from" << chain.lodPixels[l] << "pixels"
+                                << "error" << (l == 0 ? 0.0 : levels[l - 1].error);
+#else
+        Q_UNUSED(buildMs);
+#endif
+        return lodChains.size() - 1;
     }
 
-    void setColor(const QColor& color)
+private:
+    size_t addMesh(const ico::Mesh& mesh)
     {
-        for(size_t i = 0; i < primitiveSize[current]/3;++i)
+        GLfloat* positions = addPrimitive(mesh.triangles.size()*3);
+        for (size_t i = 0; i < mesh.triangles.size(); ++i)
         {
-            qreal r,g,b;
-            color.getRgbF( &r,&g,&b);
-            fillColors[current][i*3] = r;
-            fillColors[current][i*3+1] = g;
-            fillColors[current][i*3+2] = b;
+            positions[i*3] = mesh.vertices[mesh.triangles[i]].x;
+            positions[i*3+1] = mesh.vertices[mesh.triangles[i]].y;
+            positions[i*3+2] = mesh.vertices[mesh.triangles[i]].z;
         }
+        return primitives.size() - 1;
     }
 
+    // Grows the streams shared by all primitives to cover new ones.
+    void updateSharedStreams()
+    {
+        size_t maxSize = 0;
+        for (size_t size : primitiveSize)
+            maxSize = std::max(maxSize, size);
+        if (barycentrics.size() < maxSize)
+        {
+            barycentrics.assign(maxSize, 0.0f);
+            for (size_t i = 0; i < maxSize/3; ++i)
+                barycentrics[i*3 + i%3] = 1.0f;
+        }
+
+        quantizedPrimitives.resize(primitives.size(), nullptr);
+        quantizedScales.resize(primitives.size(), 1.0f);
+    }
 
-    ~Objects()
+    // Allocates positions and edge colours of a primitive as one block and
+    // fills in the constant edge colour. Returns the positions to be filled.
+    GLfloat* addPrimitive(size_t size)
     {
-        for(size_t i=0; i< primitives.size(); ++i)
+        GLfloat* block = storage.allocate<GLfloat>(size * 2);
+        primitiveSize.push_back(size);
+        primitives.push_back(block);
+        edgeColors.push_back(block + size);
+        primitiveBytes.push_back(size * 2 * sizeof(GLfloat));
+
+        for(size_t i = 0; i < size/3; ++i)
         {
-            delete[] primitives[i];
-            delete[] fillColors[i];
-            delete[] edgeColors[i];
+            edgeColors.back()[i*3] =     0.1f;
+            edgeColors.back()[i*3+1] =   0.3f;
+            edgeColors.back()[i*3+2] =   0.1f;
         }
+        return block;
     }
+
+    ico::MemoryCounter memory;
+    ico::MeshArena storage{&memory};
 };
+
+#endif // OBJECTADAPTER_H
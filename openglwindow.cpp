@@ -53,6 +53,7 @@
 #include <QOpenGLContext>
 #include <QOpenGLPaintDevice>
 #include <QPainter>
+#include <QScreen>
 
 //! [1]
 OpenGLWindow::OpenGLWindow(QWindow *parent)
@@ -64,6 +65,10 @@ OpenGLWindow::OpenGLWindow(QWindow *parent)
 
 OpenGLWindow::~OpenGLWindow()
 {
+    // Write out the frames still in flight and free the capture's buffers
+    // while the context, a child of the window, is still alive.
+    if (m_capture.active() && makeCurrent())
+        m_capture.stop(this);
     delete m_device;
 }
 //! [2]
@@ -103,6 +108,12 @@ bool OpenGLWindow::event(QEvent *event)
     case QEvent::UpdateRequest:
         renderNow();
         return true;
+    case QEvent::KeyPress:
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+        m_pacer.input();
+        return QWindow::event(event);
     default:
         return QWindow::event(event);
     }
@@ -128,6 +139,9 @@ void OpenGLWindow::renderNow()
     if (!m_context) {
         m_context = new QOpenGLContext(this);
         m_context->setFormat(requestedFormat());
+        // Null unless Qt::AA_ShareOpenGLContexts is set, in which case all
+        // windows share buffers and programs.
+        m_context->setShareContext(QOpenGLContext::globalShareContext());
         m_context->create();
 
         needsInitialize = true;
@@ -137,12 +151,27 @@ void OpenGLWindow::renderNow()
 
     if (needsInitialize) {
         initializeOpenGLFunctions();
+        m_pacer.initialize(m_context->format());
         initialize();
     }
 
+    m_pacer.beginFrame(this, screen()->refreshRate());
+
     render();
 
+    // Read back before the swap, while the back buffer holds the frame.
+    if (m_captureWanted && !m_capture.active())
+        m_captureWanted = m_capture.start(m_capturePath, m_captureFormat, qRound(screen()->refreshRate()));
+    if (m_capture.active())
+    {
+        m_capture.capture(this, size() * devicePixelRatio());
+        if (!m_captureWanted)
+            m_capture.stop(this);
+    }
+
+    m_pacer.frameSubmitted();
     m_context->swapBuffers(this);
+    m_pacer.endFrame(this);
 
     if (m_animating)
         renderLater();
@@ -159,3 +188,26 @@ void OpenGLWindow::setAnimating(bool animating)
 }
 //! [5]
 
+bool OpenGLWindow::makeCurrent()
+{
+    return m_context && m_context->makeCurrent(this);
+}
+
+void OpenGLWindow::setFramePacing(const PacingSettings &settings)
+{
+    m_pacer.setSettings(settings);
+}
+
+void OpenGLWindow::setCaptureOutput(const QString &path, CaptureFormat format)
+{
+    m_capturePath = path;
+    m_captureFormat = format;
+}
+
+void OpenGLWindow::setCapturing(bool capturing)
+{
+    m_captureWanted = capturing;
+    if (capturing)
+        renderLater();
+}
+
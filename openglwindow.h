@@ -49,7 +49,9 @@
 ****************************************************************************/
 
 #include <QWindow>
-#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include "framePacer.h"
+#include "frameCapture.h"
 
 QT_BEGIN_NAMESPACE
 class QPainter;
@@ -58,7 +60,7 @@ class QOpenGLPaintDevice;
 QT_END_NAMESPACE
 
 //! [1]
-class OpenGLWindow : public QWindow, protected QOpenGLFunctions
+class OpenGLWindow : public QWindow, protected QOpenGLExtraFunctions
 {
     Q_OBJECT
 public:
@@ -72,6 +74,16 @@ public:
 
     void setAnimating(bool animating);
 
+    // The swap interval itself is part of the surface format; the rest takes
+    // effect from the next frame.
+    void setFramePacing(const PacingSettings& settings);
+
+    // Frames are recorded to path while capturing is on. Starting and
+    // stopping take effect at the next frame.
+    void setCaptureOutput(const QString& path, CaptureFormat format);
+    void setCapturing(bool capturing);
+    bool capturing() const { return m_captureWanted; }
+
 
 public slots:
     void renderLater();
@@ -80,6 +92,10 @@ public slots:
 protected:
     bool event(QEvent *event) override;
 
+    // Makes the window's context current so that subclasses can delete their
+    // GL objects; false if no frame was ever rendered.
+    bool makeCurrent();
+
     void exposeEvent(QExposeEvent *event) override;
 
 private:
@@ -87,6 +103,12 @@ private:
 
     QOpenGLContext *m_context = nullptr;
     QOpenGLPaintDevice *m_device = nullptr;
+    FramePacer m_pacer;
+
+    FrameCapture m_capture;
+    QString m_capturePath = QStringLiteral("capture.y4m");
+    CaptureFormat m_captureFormat = CaptureFormat::Y4m;
+    bool m_captureWanted = false;
 };
 //! [1]
 
@@ -15,8 +15,26 @@ target.path = $$[QT_INSTALL_EXAMPLES]/gui/openglwindow
 INSTALLS += target
 
 HEADERS += \
+    adaptiveIcosphere.h \
     cube.h \
     customColorDialog.h \
+    faceIndex.h \
+    frameCapture.h \
+    framePacer.h \
+    frameStats.h \
+    geometryArena.h \
+    gpuPicker.h \
     icosphere.h \
+    jobSystem.h \
+    logging.h \
+    meshArena.h \
+    meshSimplifier.h \
+    multiDrawBatch.h \
     objectAdapter.h \
+    renderTarget.h \
+    resolutionController.h \
+    sceneResources.h \
+    sceneUpdate.h \
+    sdfBaker.h \
+    shaderCache.h \
     shaders.h
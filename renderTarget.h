@@ -0,0 +1,197 @@
+#ifndef RENDERTARGET_H
+#define RENDERTARGET_H
+
+#include <memory>
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QSize>
+#include <QString>
+#include "shaderCache.h"
+
+enum class AntiAliasing
+{
+    Off,
+    Msaa2,
+    Msaa4,
+    Msaa8,
+    Fxaa
+};
+
+inline const char* antiAliasingName(AntiAliasing mode)
+{
+    switch (mode)
+    {
+    case AntiAliasing::Off:   return "off";
+    case AntiAliasing::Msaa2: return "msaa2";
+    case AntiAliasing::Msaa4: return "msaa4";
+    case AntiAliasing::Msaa8: return "msaa8";
+    case AntiAliasing::Fxaa:  return "fxaa";
+    }
+    return "off";
+}
+
+inline bool parseAntiAliasing(const QString& name, AntiAliasing& mode)
+{
+    for (AntiAliasing candidate : {AntiAliasing::Off, AntiAliasing::Msaa2, AntiAliasing::Msaa4, AntiAliasing::Msaa8, AntiAliasing::Fxaa})
+        if (name == QLatin1String(antiAliasingName(candidate)))
+        {
+            mode = candidate;
+            return true;
+        }
+    return false;
+}
+
+// Where a frame is drawn before it reaches the window. With anti-aliasing off
+// at full resolution that is the window itself. Otherwise the frame goes into
+// an offscreen framebuffer: multisampled for MSAA, a texture for FXAA. It is
+// then brought onto the window by a blit or by the FXAA pass.
+//
+// A render scale below one draws into the lower-left part of the offscreen
+// buffer and stretches it over the window while resolving. The buffers keep
+// the window size, so changing the scale every frame costs no reallocation.
+class RenderTarget final
+{
+public:
+    void setMode(AntiAliasing newMode)
+    {
+        if (newMode == mode)
+            return;
+        mode = newMode;
+        framebuffer.reset();
+        resolveBuffer.reset();
+    }
+
+    AntiAliasing antiAliasing() const { return mode; }
+
+    // Fraction of the window resolution to render at, in (0, 1].
+    void setScale(double newScale) { scale = std::max(0.1, std::min(newScale, 1.0)); }
+    double renderScale() const { return scale; }
+
+    // Size of the area the frame is drawn into, in pixels.
+    QSize renderSize() const { return scaledSize; }
+
+    // Binds the target for a frame for a window of the given size in pixels
+    // and sets the viewport to the scaled area.
+    void begin(const QSize& size)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+        scaledSize = QSize(std::max(1, qRound(size.width() * scale)), std::max(1, qRound(size.height() * scale)));
+
+        if (mode == AntiAliasing::Off && scaledSize == size)
+        {
+            framebuffer.reset();
+            resolveBuffer.reset();
+            QOpenGLFramebufferObject::bindDefault();
+        }
+        else
+        {
+            ensure(framebuffer, size, samples(), QOpenGLFramebufferObject::CombinedDepthStencil);
+            framebuffer->bind();
+        }
+        f->glViewport(0, 0, scaledSize.width(), scaledSize.height());
+    }
+
+    // Brings the frame onto the window's default framebuffer.
+    void resolve(const QSize& size, ShaderCache& shaders)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+        if (!framebuffer)
+            return;
+
+        const QRect windowRect(QPoint(0, 0), size);
+        const QRect sourceRect(QPoint(0, 0), scaledSize);
+        if (mode != AntiAliasing::Fxaa)
+        {
+            // A multisampled buffer can only be blitted at 1:1, so a scaled
+            // frame is resolved into a plain buffer before stretching it.
+            QOpenGLFramebufferObject* source = framebuffer.get();
+            if (samples() > 0 && scaledSize != size)
+            {
+                ensure(resolveBuffer, size, 0, QOpenGLFramebufferObject::NoAttachment);
+                QOpenGLFramebufferObject::blitFramebuffer(resolveBuffer.get(), sourceRect, source, sourceRect, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                source = resolveBuffer.get();
+            }
+            else
+                resolveBuffer.reset();
+            QOpenGLFramebufferObject::blitFramebuffer(nullptr, windowRect, source, sourceRect, GL_COLOR_BUFFER_BIT,
+                                                      scaledSize == size ? GL_NEAREST : GL_LINEAR);
+            QOpenGLFramebufferObject::bindDefault();
+            return;
+        }
+
+        QOpenGLFramebufferObject::bindDefault();
+        f->glViewport(0, 0, size.width(), size.height());
+        f->glDisable(GL_DEPTH_TEST);
+        f->glDisable(GL_CULL_FACE);
+        f->glDisable(GL_POLYGON_OFFSET_FILL);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        static const GLfloat screenTriangle[] = { -1.0f, -1.0f, 3.0f, -1.0f, -1.0f, 3.0f };
+        const ShaderVariant& variant = shaders.program(ShaderFeature::Fxaa);
+        variant.program->bind();
+        variant.program->setUniformValue(variant.sourceUniform, 0);
+        variant.program->setUniformValue(variant.texelSizeUniform, 1.0f / size.width(), 1.0f / size.height());
+        variant.program->setUniformValue(variant.uvScaleUniform,
+                                         float(scaledSize.width()) / size.width(), float(scaledSize.height()) / size.height());
+        // Texels outside the scaled area hold older frames; samples stop at
+        // the centres of the last rendered texels.
+        variant.program->setUniformValue(variant.uvMaxUniform,
+                                         (scaledSize.width() - 0.5f) / size.width(), (scaledSize.height() - 0.5f) / size.height());
+
+        f->glActiveTexture(GL_TEXTURE0);
+        f->glBindTexture(GL_TEXTURE_2D, framebuffer->texture());
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        f->glVertexAttribPointer(variant.posAttr, 2, GL_FLOAT, GL_FALSE, 0, screenTriangle);
+        f->glEnableVertexAttribArray(variant.posAttr);
+        f->glDrawArrays(GL_TRIANGLES, 0, 3);
+        f->glDisableVertexAttribArray(variant.posAttr);
+        f->glBindTexture(GL_TEXTURE_2D, 0);
+        variant.program->release();
+    }
+
+    // Bytes held by the offscreen colour and depth/stencil buffers. The
+    // resolve buffer is colour only.
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        if (framebuffer)
+            bytes += size_t(framebuffer->width()) * framebuffer->height() * std::max(1, samples()) * (4 + 4);
+        if (resolveBuffer)
+            bytes += size_t(resolveBuffer->width()) * resolveBuffer->height() * 4;
+        return bytes;
+    }
+
+private:
+    static void ensure(std::unique_ptr<QOpenGLFramebufferObject>& buffer, const QSize& size, int samples,
+                       QOpenGLFramebufferObject::Attachment attachment)
+    {
+        if (buffer && buffer->size() == size)
+            return;
+        QOpenGLFramebufferObjectFormat format;
+        format.setAttachment(attachment);
+        format.setSamples(samples);
+        buffer.reset(new QOpenGLFramebufferObject(size, format));
+    }
+
+    int samples() const
+    {
+        switch (mode)
+        {
+        case AntiAliasing::Msaa2: return 2;
+        case AntiAliasing::Msaa4: return 4;
+        case AntiAliasing::Msaa8: return 8;
+        default:                  return 0;
+        }
+    }
+
+    AntiAliasing mode = AntiAliasing::Off;
+    double scale = 1.0;
+    QSize scaledSize;
+    std::unique_ptr<QOpenGLFramebufferObject> framebuffer;
+    std::unique_ptr<QOpenGLFramebufferObject> resolveBuffer;
+};
+
+#endif // RENDERTARGET_H
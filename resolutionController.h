@@ -0,0 +1,59 @@
+#ifndef RESOLUTIONCONTROLLER_H
+#define RESOLUTIONCONTROLLER_H
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the render scale that keeps frames within a time budget.
+//
+// Fill cost grows with the pixel count, i.e. with the square of the scale, so
+// the scale that would exactly meet the budget is scale * sqrt(budget / time).
+// The controller moves part of the way there each frame, ignores errors
+// inside a small dead band so the image does not shimmer, and snaps to steps
+// of 1/32.
+class ResolutionController final
+{
+public:
+    double budget = 16.6;    // milliseconds
+    double minScale = 0.5;
+    double maxScale = 1.0;
+    double gain = 0.25;      // fraction of the correction applied per frame
+    double deadBand = 0.05;  // relative error that is left alone
+
+    double scale() const { return current; }
+
+    void reset()
+    {
+        current = maxScale;
+        smoothed = 0.0;
+    }
+
+    // Feeds the render cost of the last frame in milliseconds and returns the
+    // scale to use for the next one. The cost must not include waiting for
+    // vsync, or a budget below the refresh period can never be met.
+    double update(double frameTime)
+    {
+        if (frameTime <= 0.0)
+            return current;
+        smoothed = smoothed > 0.0 ? smoothed + (frameTime - smoothed) * 0.2 : frameTime;
+
+        const double ratio = budget / smoothed;
+        if (std::fabs(ratio - 1.0) < deadBand)
+            return current;
+
+        // Grow more cautiously than we shrink: overshooting costs a late frame.
+        const double target = current * std::sqrt(ratio);
+        const double step = ratio < 1.0 ? gain : gain * 0.5;
+        double next = std::round((current + (target - current) * step) * 32.0) / 32.0;
+        if (next == current)
+            next += ratio < 1.0 ? -1.0 / 32.0 : 1.0 / 32.0;
+        current = std::max(minScale, std::min(maxScale, next));
+        return current;
+    }
+
+private:
+    double current = 1.0;
+    double smoothed = 0.0;
+};
+
+#endif // RESOLUTIONCONTROLLER_H
@@ -0,0 +1,74 @@
+#ifndef SCENERESOURCES_H
+#define SCENERESOURCES_H
+
+#include <vector>
+#include <QObject>
+#include <QOpenGLBuffer>
+#include "faceIndex.h"
+#include "geometryArena.h"
+#include "jobSystem.h"
+#include "objectAdapter.h"
+#include "shaderCache.h"
+
+// Everything the views of one scene have in common: the geometry, the job
+// system and the GL objects that live in the context share group, which are
+// buffers and shader programs. Framebuffers and vertex array objects are
+// per context, so each view keeps its own.
+//
+// Views hold the resources through a shared pointer. GL objects are created by
+// the first view to initialize and outlive any single view, as long as all
+// views' contexts share with QOpenGLContext::globalShareContext().
+class SceneResources final : public QObject
+{
+public:
+    SceneResources()
+        : shaders(this)
+        , baseVertexBuffer(QOpenGLBuffer::VertexBuffer)
+        , baseIndexBuffer(QOpenGLBuffer::IndexBuffer)
+    {
+        baseFaces.assign(objects.baseIndices.begin(), objects.baseIndices.end());
+    }
+
+    // Uploads the shared buffers, once for all views. Needs a context of the
+    // share group current.
+    void initializeGL(bool tessellation)
+    {
+        if (tessellation && !baseVertexBuffer.isCreated())
+        {
+            baseVertexBuffer.create();
+            baseVertexBuffer.bind();
+            baseVertexBuffer.allocate(objects.baseVertices.data(), objects.baseVertices.size() * sizeof(GLfloat));
+            baseVertexBuffer.release();
+            baseIndexBuffer.create();
+            baseIndexBuffer.bind();
+            baseIndexBuffer.allocate(objects.baseIndices.data(), objects.baseIndices.size() * sizeof(GLuint));
+            baseIndexBuffer.release();
+        }
+
+        // Primitives added since the last view initialized, such as LOD
+        // chains of imported meshes, join the arena here.
+        while (geometry.rangeCount() < objects.primitives.size())
+        {
+            const size_t i = geometry.rangeCount();
+            geometry.addTriangles(objects.primitives[i], objects.primitiveSize[i] / 3);
+        }
+        geometry.upload();
+    }
+
+    Objects objects;
+    ShaderCache shaders;
+    JobSystem jobs;
+    ico::FaceIndex faceIndex;
+
+    // The base icosahedron on the GPU, for tessellation, and its faces as
+    // uniform data, for the procedural path.
+    QOpenGLBuffer baseVertexBuffer;
+    QOpenGLBuffer baseIndexBuffer;
+    std::vector<GLint> baseFaces;
+
+    // Every primitive of objects, range i holding primitive i, welded and
+    // indexed in one vertex and one index buffer for batched drawing.
+    GeometryArena geometry;
+};
+
+#endif // SCENERESOURCES_H
@@ -0,0 +1,304 @@
+#ifndef SCENEUPDATE_H
+#define SCENEUPDATE_H
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "jobSystem.h"
+
+// Per-object CPU work for large scenes: transform composition, bounds,
+// frustum culling and LOD selection. Objects live in structure-of-arrays form
+// and the visible ones end up as column-major model matrices in one instance
+// buffer per LOD level, ready to be fed to an instanced draw.
+class SceneUpdate final
+{
+public:
+    struct Transforms
+    {
+        std::vector<float> posX, posY, posZ;
+        std::vector<float> axisX, axisY, axisZ;
+        std::vector<float> angle, spin;
+        std::vector<float> scale;
+
+        size_t size() const { return posX.size(); }
+    };
+
+    struct StageTimings
+    {
+        double compose = 0.0;
+        double cull = 0.0;
+        double compact = 0.0;
+
+        double total() const { return compose + cull + compact; }
+    };
+
+    // Parameters of one frame. viewProjection is column-major like
+    // QMatrix4x4::constData(); pixelScale is the viewport height divided by
+    // 2*tan(fov/2), which turns radius/distance into a radius in pixels.
+    struct View
+    {
+        const float *viewProjection = nullptr;
+        float cameraX = 0.0f, cameraY = 0.0f, cameraZ = 0.0f;
+        float pixelScale = 1.0f;
+        float time = 0.0f;
+    };
+
+    static const size_t grain = 1024;
+
+    explicit SceneUpdate(JobSystem &jobs) : jobs(&jobs) {}
+
+    // lodPixels[i] is the smallest projected radius in pixels that still
+    // selects level i; levels are ordered finest first, so the thresholds
+    // decrease. localRadius is the bounding radius of the unscaled mesh.
+    void setLevels(const std::vector<float> &lodPixels, float localRadius)
+    {
+        thresholds = lodPixels;
+        meshRadius = localRadius;
+        instances.assign(thresholds.size(), std::vector<float>());
+        instanceObjects.assign(thresholds.size(), std::vector<uint32_t>());
+        instanceCounts.assign(thresholds.size(), 0);
+    }
+
+    // Scatters count objects with random spin axes in a box in front of a
+    // camera looking down -Z.
+    void populate(size_t count, float extent, unsigned seed = 1)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+        transforms = Transforms();
+        for (size_t i = 0; i < count; ++i)
+        {
+            transforms.posX.push_back(unit(random) * extent);
+            transforms.posY.push_back(unit(random) * extent);
+            transforms.posZ.push_back(-2.0f - positive(random) * extent * 2.0f);
+
+            float ax = unit(random), ay = unit(random), az = unit(random);
+            const float length = std::sqrt(ax*ax + ay*ay + az*az) + 1e-6f;
+            transforms.axisX.push_back(ax / length);
+            transforms.axisY.push_back(ay / length);
+            transforms.axisZ.push_back(az / length);
+
+            transforms.angle.push_back(positive(random) * 6.2831853f);
+            transforms.spin.push_back(unit(random) * 2.0f);
+            transforms.scale.push_back(0.2f + positive(random) * 0.6f);
+        }
+
+        world.assign(count * 16, 0.0f);
+        radius.assign(count, 0.0f);
+        level.assign(count, -1);
+    }
+
+    void update(const View &view)
+    {
+        typedef std::chrono::steady_clock Clock;
+        const Clock::time_point start = Clock::now();
+        compose(view.time);
+        const Clock::time_point composed = Clock::now();
+        cull(view);
+        const Clock::time_point culled = Clock::now();
+        compact();
+        const Clock::time_point compacted = Clock::now();
+
+        timings.compose = std::chrono::duration<double, std::milli>(composed - start).count();
+        timings.cull = std::chrono::duration<double, std::milli>(culled - composed).count();
+        timings.compact = std::chrono::duration<double, std::milli>(compacted - culled).count();
+    }
+
+    size_t objectCount() const { return transforms.size(); }
+    size_t visibleCount() const
+    {
+        size_t visible = 0;
+        for (size_t count : instanceCounts)
+            visible += count;
+        return visible;
+    }
+
+    Transforms transforms;
+
+    // Output: instanceCounts[l] matrices of 16 floats in instances[l], and
+    // the index of the object each of them came from in instanceObjects[l].
+    std::vector<std::vector<float>> instances;
+    std::vector<std::vector<uint32_t>> instanceObjects;
+    std::vector<size_t> instanceCounts;
+    StageTimings timings;
+
+private:
+    void compose(float time)
+    {
+        jobs->parallelFor(transforms.size(), grain, [this, time](size_t begin, size_t end)
+        {
+            const Transforms &t = transforms;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const float a = t.angle[i] + t.spin[i] * time;
+                const float c = std::cos(a), s = std::sin(a), k = 1.0f - c;
+                const float x = t.axisX[i], y = t.axisY[i], z = t.axisZ[i];
+                const float sc = t.scale[i];
+
+                // T * R(axis, a) * S, column-major.
+                float *m = &world[i * 16];
+                m[0]  = (x*x*k + c)   * sc; m[1]  = (y*x*k + z*s) * sc; m[2]  = (z*x*k - y*s) * sc; m[3]  = 0.0f;
+                m[4]  = (x*y*k - z*s) * sc; m[5]  = (y*y*k + c)   * sc; m[6]  = (z*y*k + x*s) * sc; m[7]  = 0.0f;
+                m[8]  = (x*z*k + y*s) * sc; m[9]  = (y*z*k - x*s) * sc; m[10] = (z*z*k + c)   * sc; m[11] = 0.0f;
+                m[12] = t.posX[i];          m[13] = t.posY[i];          m[14] = t.posZ[i];          m[15] = 1.0f;
+
+                radius[i] = meshRadius * sc;
+            }
+        });
+    }
+
+    void cull(const View &view)
+    {
+        float planes[6][4];
+        const float *m = view.viewProjection;
+        for (int p = 0; p < 6; ++p)
+        {
+            const int row = p / 2;
+            const float sign = (p % 2) ? -1.0f : 1.0f;
+            for (int c = 0; c < 4; ++c)
+                planes[p][c] = m[c*4 + 3] + sign * m[c*4 + row];
+            const float length = std::sqrt(planes[p][0]*planes[p][0] + planes[p][1]*planes[p][1] + planes[p][2]*planes[p][2]);
+            for (int c = 0; c < 4; ++c)
+                planes[p][c] /= length;
+        }
+
+        jobs->parallelFor(transforms.size(), grain, [this, &view, &planes](size_t begin, size_t end)
+        {
+            const Transforms &t = transforms;
+            for (size_t i = begin; i < end; ++i)
+            {
+                const float x = t.posX[i], y = t.posY[i], z = t.posZ[i], r = radius[i];
+
+                bool visible = true;
+                for (int p = 0; p < 6 && visible; ++p)
+                    visible = planes[p][0]*x + planes[p][1]*y + planes[p][2]*z + planes[p][3] >= -r;
+
+                int selected = -1;
+                if (visible)
+                {
+                    const float dx = x - view.cameraX, dy = y - view.cameraY, dz = z - view.cameraZ;
+                    const float distance = std::sqrt(dx*dx + dy*dy + dz*dz);
+                    const float pixels = distance > r ? r / distance * view.pixelScale : view.pixelScale;
+                    selected = static_cast<int>(thresholds.size()) - 1;
+                    for (size_t l = 0; l < thresholds.size(); ++l)
+                        if (pixels >= thresholds[l])
+                        {
+                            selected = static_cast<int>(l);
+                            break;
+                        }
+                }
+                level[i] = selected;
+            }
+        });
+    }
+
+    void compact()
+    {
+        const size_t levels = thresholds.size();
+        const size_t chunks = (transforms.size() + grain - 1) / grain;
+        chunkOffsets.assign(chunks * levels, 0);
+
+        // Count per chunk and level, then turn the counts into write offsets
+        // so every chunk scatters into its own slice of the instance buffers.
+        jobs->parallelFor(chunks, 1, [this, levels](size_t begin, size_t end)
+        {
+            for (size_t chunk = begin; chunk < end; ++chunk)
+            {
+                const size_t last = std::min(transforms.size(), (chunk + 1) * grain);
+                for (size_t i = chunk * grain; i < last; ++i)
+                    if (level[i] >= 0)
+                        ++chunkOffsets[chunk * levels + level[i]];
+            }
+        });
+
+        for (size_t l = 0; l < levels; ++l)
+        {
+            size_t offset = 0;
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+            {
+                const size_t count = chunkOffsets[chunk * levels + l];
+                chunkOffsets[chunk * levels + l] = offset;
+                offset += count;
+            }
+            instanceCounts[l] = offset;
+            if (instances[l].size() < offset * 16)
+                instances[l].resize(offset * 16);
+            if (instanceObjects[l].size() < offset)
+                instanceObjects[l].resize(offset);
+        }
+
+        jobs->parallelFor(chunks, 1, [this, levels](size_t begin, size_t end)
+        {
+            for (size_t chunk = begin; chunk < end; ++chunk)
+            {
+                size_t *offsets = &chunkOffsets[chunk * levels];
+                const size_t last = std::min(transforms.size(), (chunk + 1) * grain);
+                for (size_t i = chunk * grain; i < last; ++i)
+                {
+                    if (level[i] < 0)
+                        continue;
+                    const size_t slot = offsets[level[i]]++;
+                    std::copy(&world[i * 16], &world[i * 16] + 16, &instances[level[i]][slot * 16]);
+                    instanceObjects[level[i]][slot] = static_cast<uint32_t>(i);
+                }
+            }
+        });
+    }
+
+    JobSystem *jobs;
+
+    std::vector<float> thresholds;
+    float meshRadius = 1.0f;
+
+    std::vector<float> world;
+    std::vector<float> radius;
+    std::vector<int> level;
+    std::vector<size_t> chunkOffsets;
+};
+
+struct ScalingSample
+{
+    unsigned threads;
+    SceneUpdate::StageTimings timings;
+};
+
+// Runs the same update with 1, 2, 4, ... threads up to the core count and
+// reports the average stage timings for each, so the speedup can be read off.
+inline std::vector<ScalingSample> measureSceneScaling(size_t objectCount, const SceneUpdate::View &view,
+                                                      const std::vector<float> &lodPixels, float localRadius,
+                                                      int iterations = 20)
+{
+    std::vector<ScalingSample> samples;
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, cores))
+    {
+        JobSystem jobs(threads - 1);
+        SceneUpdate scene(jobs);
+        scene.setLevels(lodPixels, localRadius);
+        scene.populate(objectCount, 40.0f);
+
+        ScalingSample sample;
+        sample.threads = threads;
+        scene.update(view);
+        for (int i = 0; i < iterations; ++i)
+        {
+            SceneUpdate::View frame = view;
+            frame.time += i * 0.016f;
+            scene.update(frame);
+            sample.timings.compose += scene.timings.compose / iterations;
+            sample.timings.cull += scene.timings.cull / iterations;
+            sample.timings.compact += scene.timings.compact / iterations;
+        }
+        samples.push_back(sample);
+
+        if (threads == cores)
+            break;
+    }
+    return samples;
+}
+
+#endif // SCENEUPDATE_H
@@ -0,0 +1,528 @@
+#ifndef SDFBAKER_H
+#define SDFBAKER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "icosphere.h"
+#include "jobSystem.h"
+
+namespace ico
+{
+
+// Where the distance field is sampled: nx * ny * nz points starting at origin,
+// voxelSize apart, grouped into cubic bricks of brickSize points a side.
+struct SdfGrid
+{
+    Vector3 origin = Vector3(0.0);
+    double voxelSize = 1.0;
+    uint32_t nx = 0, ny = 0, nz = 0;
+    uint32_t brickSize = 8;
+
+    uint32_t bricksX() const { return (nx + brickSize - 1) / brickSize; }
+    uint32_t bricksY() const { return (ny + brickSize - 1) / brickSize; }
+    uint32_t bricksZ() const { return (nz + brickSize - 1) / brickSize; }
+    size_t brickCount() const { return size_t(bricksX()) * bricksY() * bricksZ(); }
+    size_t brickVoxels() const { return size_t(brickSize) * brickSize * brickSize; }
+
+    Vector3 position(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        return origin + Vector3(voxelSize) * Vector3(x, y, z);
+    }
+
+    // A grid of at most resolution points along the longest side of the mesh
+    // bounds, with padding voxels of empty space around the mesh.
+    static SdfGrid fit(const Mesh &mesh, uint32_t resolution, uint32_t padding = 2, uint32_t brickSize = 8)
+    {
+        Vector3 lo(1e30), hi(-1e30);
+        for (const Vector3 &v : mesh.vertices)
+        {
+            lo = Vector3(std::fmin(lo.x, v.x), std::fmin(lo.y, v.y), std::fmin(lo.z, v.z));
+            hi = Vector3(std::fmax(hi.x, v.x), std::fmax(hi.y, v.y), std::fmax(hi.z, v.z));
+        }
+        const Vector3 extent = hi - lo;
+        const double longest = std::fmax(extent.x, std::fmax(extent.y, extent.z));
+        const uint32_t inner = std::max<uint32_t>(resolution, 2 * padding + 2) - 2 * padding - 1;
+
+        SdfGrid grid;
+        grid.brickSize = std::max<uint32_t>(brickSize, 1);
+        grid.voxelSize = longest > 0.0 ? longest / inner : 1.0;
+        grid.origin = lo - Vector3(padding * grid.voxelSize);
+        grid.nx = uint32_t(std::ceil(extent.x / grid.voxelSize)) + 2 * padding + 1;
+        grid.ny = uint32_t(std::ceil(extent.y / grid.voxelSize)) + 2 * padding + 1;
+        grid.nz = uint32_t(std::ceil(extent.z / grid.voxelSize)) + 2 * padding + 1;
+        return grid;
+    }
+};
+
+enum class SdfSign
+{
+    // Sign of the closest triangle's normal, preferring the triangle that
+    // faces p most directly when several share the closest point. Cheap, but
+    // needs a closed, consistently wound mesh.
+    Normals,
+    // Generalized winding number, tolerant of small holes and overlaps but
+    // a pass over every triangle for each baked voxel.
+    Winding
+};
+
+struct SdfSettings
+{
+    // Distances are exact up to band (in voxels) and clamped beyond it.
+    // Bricks with no triangle within the band plus half a brick diagonal
+    // are not baked. 0 bakes every brick against every triangle, giving a
+    // dense, unclamped field.
+    double band = 4.0;
+    SdfSign sign = SdfSign::Normals;
+};
+
+struct SdfBakeStats
+{
+    size_t bakedBricks = 0;
+    size_t skippedBricks = 0;
+    size_t bakedVoxels = 0;
+    double seconds = 0.0;
+
+    // Voxels of the whole grid per second, counting skipped bricks as done.
+    double voxelsPerSecond(const SdfGrid &grid) const
+    {
+        return seconds > 0.0 ? double(grid.nx) * grid.ny * grid.nz / seconds : 0.0;
+    }
+};
+
+// A brick-sparse distance volume. Each brick is either a run of
+// brickVoxels() floats in data (x fastest) or a constant far value.
+struct SdfVolume
+{
+    enum : int32_t { FarOutside = -1, FarInside = -2 };
+
+    SdfGrid grid;
+    float band = 0.0f;  // world units, 0 for a dense field
+    std::vector<int32_t> bricks; // index into data in bricks, or Far*
+    std::vector<float> data;
+
+    float value(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        const uint32_t bs = grid.brickSize;
+        const int32_t brick = bricks[(size_t(z / bs) * grid.bricksY() + y / bs) * grid.bricksX() + x / bs];
+        if (brick == FarOutside)
+            return band;
+        if (brick == FarInside)
+            return -band;
+        return data[size_t(brick) * grid.brickVoxels() + (size_t(z % bs) * bs + y % bs) * bs + x % bs];
+    }
+
+    // Layout, native endianness: the 64-byte FileHeader, the brick table as
+    // int32, then the brick data as float starting at dataOffset, which is
+    // page aligned so the payload can be mapped directly.
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t nx, ny, nz;
+        uint32_t brickSize;
+        float origin[3];
+        float voxelSize;
+        float band;
+        uint32_t storedBricks;
+        uint64_t tableOffset;
+        uint64_t dataOffset;
+    };
+    static_assert(sizeof(FileHeader) == 64, "SDF file header must stay 64 bytes");
+
+    bool write(const std::string &path) const
+    {
+        const uint64_t page = 4096;
+        FileHeader header;
+        std::memcpy(header.magic, "ISDF", 4);
+        header.version = 1;
+        header.nx = grid.nx;
+        header.ny = grid.ny;
+        header.nz = grid.nz;
+        header.brickSize = grid.brickSize;
+        header.origin[0] = float(grid.origin.x);
+        header.origin[1] = float(grid.origin.y);
+        header.origin[2] = float(grid.origin.z);
+        header.voxelSize = float(grid.voxelSize);
+        header.band = band;
+        header.storedBricks = uint32_t(data.size() / grid.brickVoxels());
+        header.tableOffset = sizeof(FileHeader);
+        header.dataOffset = (header.tableOffset + bricks.size() * sizeof(int32_t) + page - 1) / page * page;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(bricks.data()), bricks.size() * sizeof(int32_t));
+        const std::vector<char> padding(header.dataOffset - header.tableOffset - bricks.size() * sizeof(int32_t), 0);
+        file.write(padding.data(), padding.size());
+        file.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(float));
+        return bool(file);
+    }
+};
+
+// Bakes the signed distance to mesh at every grid point.
+//
+// Each triangle is binned into the bricks its expanded bounds touch, so a
+// brick only ever tests its own short list. The bounds grow by the band plus
+// half a brick diagonal, so a voxel with a listed triangle within that reach
+// also has its closest triangle listed. Bricks with an empty list are
+// skipped and given a constant far value; the baked bricks are shared out
+// over the job system one brick at a time.
+//
+// The brick lists, triangle bounds and flood fill are allocated from scratch
+// when it is given. The arena is not thread safe, so the per-brick working
+// lists of the jobs stay on the heap.
+inline SdfVolume BakeSdf(const Mesh &mesh, const SdfGrid &grid, const SdfSettings &settings, JobSystem &jobs, SdfBakeStats *stats = nullptr, MeshArena *scratch = nullptr)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    SdfVolume volume;
+    volume.grid = grid;
+    const bool dense = settings.band <= 0.0;
+    const double band = settings.band * grid.voxelSize;
+    volume.band = dense ? 0.0f : float(band);
+
+    const uint32_t bx = grid.bricksX(), by = grid.bricksY(), bz = grid.bricksZ();
+    const size_t brickCount = grid.brickCount();
+    const double brickSpan = grid.brickSize * grid.voxelSize;
+    const double reach = band + 0.5 * std::sqrt(3.0) * brickSpan;
+    const uint32_t triangleCount = mesh.triangleCount();
+
+    // Triangle lists per brick, stored as offsets into one index array. A
+    // dense bake uses a single list of every triangle instead.
+    ArenaVector<uint32_t> listStart(brickCount + 1, 0, ArenaAllocator<uint32_t>(scratch));
+    ArenaVector<uint32_t> listTriangles((ArenaAllocator<uint32_t>(scratch)));
+    ArenaVector<uint32_t> allTriangles(triangleCount, 0, ArenaAllocator<uint32_t>(scratch));
+    ArenaVector<uint32_t> brickRange((ArenaAllocator<uint32_t>(scratch))); // per triangle: x0, x1, y0, y1, z0, z1
+    for (uint32_t t = 0; t < triangleCount; ++t)
+        allTriangles[t] = t * 3;
+    if (!dense)
+    {
+        const auto toBricks = [&](double lo, double hi, double origin, uint32_t bricks, uint32_t &first, uint32_t &last)
+        {
+            const double a = std::ceil(((lo - origin) / grid.voxelSize - (grid.brickSize - 1)) / grid.brickSize);
+            const double b = std::floor((hi - origin) / brickSpan);
+            if (b < 0.0 || a > double(bricks) - 1.0 || a > b)
+                return false;
+            first = uint32_t(std::max(a, 0.0));
+            last = uint32_t(std::min(b, double(bricks) - 1.0));
+            return true;
+        };
+
+        brickRange.resize(size_t(triangleCount) * 6);
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            const Vector3 &v0 = mesh.vertices[mesh.triangles[t * 3]];
+            const Vector3 &v1 = mesh.vertices[mesh.triangles[t * 3 + 1]];
+            const Vector3 &v2 = mesh.vertices[mesh.triangles[t * 3 + 2]];
+            const Vector3 lo(std::fmin(v0.x, std::fmin(v1.x, v2.x)) - reach, std::fmin(v0.y, std::fmin(v1.y, v2.y)) - reach, std::fmin(v0.z, std::fmin(v1.z, v2.z)) - reach);
+            const Vector3 hi(std::fmax(v0.x, std::fmax(v1.x, v2.x)) + reach, std::fmax(v0.y, std::fmax(v1.y, v2.y)) + reach, std::fmax(v0.z, std::fmax(v1.z, v2.z)) + reach);
+            uint32_t *range = &brickRange[size_t(t) * 6];
+            if (!toBricks(lo.x, hi.x, grid.origin.x, bx, range[0], range[1]) ||
+                !toBricks(lo.y, hi.y, grid.origin.y, by, range[2], range[3]) ||
+                !toBricks(lo.z, hi.z, grid.origin.z, bz, range[4], range[5]))
+            {
+                range[0] = 1;
+                range[1] = 0;
+                continue;
+            }
+            for (uint32_t z = range[4]; z <= range[5]; ++z)
+                for (uint32_t y = range[2]; y <= range[3]; ++y)
+                    for (uint32_t x = range[0]; x <= range[1]; ++x)
+                        ++listStart[(size_t(z) * by + y) * bx + x + 1];
+        }
+        for (size_t b = 0; b < brickCount; ++b)
+            listStart[b + 1] += listStart[b];
+
+        listTriangles.resize(listStart[brickCount]);
+        ArenaVector<uint32_t> fill(listStart.begin(), listStart.end() - 1, ArenaAllocator<uint32_t>(scratch));
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            const uint32_t *range = &brickRange[size_t(t) * 6];
+            if (range[0] > range[1])
+                continue;
+            for (uint32_t z = range[4]; z <= range[5]; ++z)
+                for (uint32_t y = range[2]; y <= range[3]; ++y)
+                    for (uint32_t x = range[0]; x <= range[1]; ++x)
+                        listTriangles[fill[(size_t(z) * by + y) * bx + x]++] = t * 3;
+        }
+    }
+
+    // Triangle bounds, and the squared distance from p to those of the
+    // triangle starting at index t.
+    ArenaVector<Vector3> bounds(size_t(triangleCount) * 2, Vector3(0.0), ArenaAllocator<Vector3>(scratch)); // per triangle: lo, hi
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        const Vector3 &v0 = mesh.vertices[mesh.triangles[t * 3]];
+        const Vector3 &v1 = mesh.vertices[mesh.triangles[t * 3 + 1]];
+        const Vector3 &v2 = mesh.vertices[mesh.triangles[t * 3 + 2]];
+        bounds[t * 2] = Vector3(std::fmin(v0.x, std::fmin(v1.x, v2.x)), std::fmin(v0.y, std::fmin(v1.y, v2.y)), std::fmin(v0.z, std::fmin(v1.z, v2.z)));
+        bounds[t * 2 + 1] = Vector3(std::fmax(v0.x, std::fmax(v1.x, v2.x)), std::fmax(v0.y, std::fmax(v1.y, v2.y)), std::fmax(v0.z, std::fmax(v1.z, v2.z)));
+    }
+    const auto boundsDistance2 = [&bounds](const Vector3 &p, uint32_t t)
+    {
+        const Vector3 &lo = bounds[t / 3 * 2], &hi = bounds[t / 3 * 2 + 1];
+        const Vector3 gap(std::fmax(0.0, std::fmax(lo.x - p.x, p.x - hi.x)),
+                          std::fmax(0.0, std::fmax(lo.y - p.y, p.y - hi.y)),
+                          std::fmax(0.0, std::fmax(lo.z - p.z, p.z - hi.z)));
+        return dot(gap, gap);
+    };
+
+    // Orders list by how far each triangle's bounds are from centre.
+    const auto sortByGap = [&boundsDistance2](const Vector3 &centre, const uint32_t *list, size_t listSize, std::vector<uint32_t> &sorted, std::vector<double> &gaps)
+    {
+        std::vector<std::pair<double, uint32_t>> order(listSize);
+        for (size_t t = 0; t < listSize; ++t)
+            order[t] = std::make_pair(std::sqrt(boundsDistance2(centre, list[t])), list[t]);
+        std::sort(order.begin(), order.end());
+        sorted.resize(listSize);
+        gaps.resize(listSize);
+        for (size_t t = 0; t < listSize; ++t)
+        {
+            gaps[t] = order[t].first;
+            sorted[t] = order[t].second;
+        }
+    };
+
+    // Squared distance from p to the closest triangle in list, and whether p
+    // lies on the outside of it, preferring the triangle that faces p most
+    // directly when several share the closest point. The list is ordered by
+    // gap, its distance from a point no further than slack from p, so the
+    // search stops once no triangle left can be as close.
+    const auto closest = [&mesh, &boundsDistance2](const Vector3 &p, const uint32_t *list, const double *gaps, size_t listSize, double slack, bool &outside)
+    {
+        double best = 1e30;
+        double bestFacing = -1.0;
+        outside = true;
+        for (size_t t = 0; t < listSize; ++t)
+        {
+            const double bound = gaps[t] - slack;
+            if (bound > 0.0 && bound * bound > best * (1.0 + 1e-9))
+                break;
+            if (boundsDistance2(p, list[t]) > best * (1.0 + 1e-9))
+                continue;
+
+            const Vector3 d = p - mesh.closestPoint(p, list[t]);
+            const double distance2 = dot(d, d);
+            if (distance2 > best * (1.0 + 1e-9))
+                continue;
+
+            const Vector3 &v0 = mesh.vertices[mesh.triangles[list[t]]];
+            const Vector3 n = cross(mesh.vertices[mesh.triangles[list[t] + 1]] - v0, mesh.vertices[mesh.triangles[list[t] + 2]] - v0);
+            const double along = dot(d, n);
+            const double facing = std::fabs(along) / std::sqrt(std::fmax(distance2 * dot(n, n), 1e-300));
+            if (distance2 < best * (1.0 - 1e-9) || facing > bestFacing)
+            {
+                bestFacing = facing;
+                outside = along >= 0.0;
+            }
+            best = std::fmin(best, distance2);
+        }
+        return best;
+    };
+
+    const auto windingNumber = [&mesh](const Vector3 &p)
+    {
+        double solidAngle = 0.0;
+        for (uint32_t i = 0; i < mesh.triangles.size(); i += 3)
+        {
+            const Vector3 a = mesh.vertices[mesh.triangles[i]] - p;
+            const Vector3 b = mesh.vertices[mesh.triangles[i + 1]] - p;
+            const Vector3 c = mesh.vertices[mesh.triangles[i + 2]] - p;
+            const double la = length(a), lb = length(b), lc = length(c);
+            solidAngle += 2.0 * std::atan2(dot(a, cross(b, c)), la * lb * lc + dot(a, b) * lc + dot(b, c) * la + dot(c, a) * lb);
+        }
+        return solidAngle / (4.0 * M_PI);
+    };
+
+    // Decide which bricks get baked and hand out their data slots.
+    ArenaVector<uint32_t> baked((ArenaAllocator<uint32_t>(scratch)));
+    volume.bricks.assign(brickCount, SdfVolume::FarOutside);
+    for (size_t b = 0; b < brickCount; ++b)
+    {
+        if (dense || listStart[b + 1] > listStart[b])
+        {
+            volume.bricks[b] = int32_t(baked.size());
+            baked.push_back(uint32_t(b));
+        }
+    }
+    volume.data.resize(baked.size() * grid.brickVoxels());
+
+    jobs.parallelFor(baked.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t b = baked[i];
+            const uint32_t brickX = b % bx, brickY = (b / bx) % by, brickZ = b / (size_t(bx) * by);
+            const Vector3 centre = grid.origin + Vector3(brickSpan) * Vector3(brickX + 0.5, brickY + 0.5, brickZ + 0.5);
+            std::vector<uint32_t> list;
+            std::vector<double> gaps;
+            if (dense)
+                sortByGap(centre, allTriangles.data(), allTriangles.size(), list, gaps);
+            else
+                sortByGap(centre, &listTriangles[listStart[b]], listStart[b + 1] - listStart[b], list, gaps);
+            float *out = &volume.data[i * grid.brickVoxels()];
+            std::vector<uint32_t> far; // voxels with nothing listed within reach
+
+            for (uint32_t z = 0; z < grid.brickSize; ++z)
+                for (uint32_t y = 0; y < grid.brickSize; ++y)
+                    for (uint32_t x = 0; x < grid.brickSize; ++x)
+                    {
+                        const Vector3 p = grid.position(brickX * grid.brickSize + x, brickY * grid.brickSize + y, brickZ * grid.brickSize + z);
+                        bool outside = true;
+                        const double best = closest(p, list.data(), gaps.data(), list.size(), length(p - centre), outside);
+                        if (!dense && best > reach * reach && settings.sign == SdfSign::Normals)
+                            far.push_back(uint32_t((z * grid.brickSize + y) * grid.brickSize + x));
+
+                        double distance = std::sqrt(best);
+                        if (!dense)
+                            distance = std::fmin(distance, band);
+                        if (settings.sign == SdfSign::Winding)
+                            outside = windingNumber(p) < 0.5;
+                        *out++ = float(outside ? distance : -distance);
+                    }
+            if (far.empty())
+                continue;
+
+            // Past reach the closest triangle may be missing from the list,
+            // which would give the clamped distance the wrong sign, so those
+            // voxels search every triangle.
+            sortByGap(centre, allTriangles.data(), allTriangles.size(), list, gaps);
+            float *brick = &volume.data[i * grid.brickVoxels()];
+            for (uint32_t v : far)
+            {
+                const uint32_t x = v % grid.brickSize, y = (v / grid.brickSize) % grid.brickSize, z = v / (grid.brickSize * grid.brickSize);
+                const Vector3 p = grid.position(brickX * grid.brickSize + x, brickY * grid.brickSize + y, brickZ * grid.brickSize + z);
+                bool outside = true;
+                closest(p, list.data(), gaps.data(), list.size(), length(p - centre), outside);
+                brick[v] = outside ? std::fabs(brick[v]) : -std::fabs(brick[v]);
+            }
+        }
+    });
+
+    // Skipped bricks are wholly inside or outside. The winding number at the
+    // brick centre settles which; otherwise flood the outside in from the
+    // grid boundary, stopping at baked bricks, which wall off the surface.
+    if (!dense)
+    {
+        const auto index = [bx, by](uint32_t x, uint32_t y, uint32_t z) { return (size_t(z) * by + y) * bx + x; };
+        if (settings.sign == SdfSign::Winding)
+        {
+            jobs.parallelFor(brickCount, 16, [&](size_t begin, size_t end)
+            {
+                for (size_t b = begin; b < end; ++b)
+                {
+                    if (volume.bricks[b] >= 0)
+                        continue;
+                    const Vector3 centre = grid.origin + Vector3(brickSpan) * Vector3(b % bx + 0.5, (b / bx) % by + 0.5, b / (size_t(bx) * by) + 0.5);
+                    if (windingNumber(centre) >= 0.5)
+                        volume.bricks[b] = SdfVolume::FarInside;
+                }
+            });
+        }
+        else
+        {
+            ArenaVector<uint8_t> reached(brickCount, 0, ArenaAllocator<uint8_t>(scratch));
+            ArenaVector<uint32_t> open((ArenaAllocator<uint32_t>(scratch)));
+            const auto visit = [&](uint32_t x, uint32_t y, uint32_t z)
+            {
+                const size_t b = index(x, y, z);
+                if (!reached[b] && volume.bricks[b] < 0)
+                {
+                    reached[b] = 1;
+                    open.push_back(uint32_t(b));
+                }
+            };
+            for (uint32_t z = 0; z < bz; ++z)
+                for (uint32_t y = 0; y < by; ++y)
+                    for (uint32_t x = 0; x < bx; ++x)
+                        if (x == 0 || y == 0 || z == 0 || x == bx - 1 || y == by - 1 || z == bz - 1)
+                            visit(x, y, z);
+            while (!open.empty())
+            {
+                const uint32_t b = open.back();
+                open.pop_back();
+                const uint32_t x = b % bx, y = (b / bx) % by, z = b / (bx * by);
+                if (x > 0) visit(x - 1, y, z);
+                if (x + 1 < bx) visit(x + 1, y, z);
+                if (y > 0) visit(x, y - 1, z);
+                if (y + 1 < by) visit(x, y + 1, z);
+                if (z > 0) visit(x, y, z - 1);
+                if (z + 1 < bz) visit(x, y, z + 1);
+            }
+            for (size_t b = 0; b < brickCount; ++b)
+                if (volume.bricks[b] < 0 && !reached[b])
+                    volume.bricks[b] = SdfVolume::FarInside;
+        }
+    }
+
+    if (stats)
+    {
+        stats->bakedBricks = baked.size();
+        stats->skippedBricks = brickCount - baked.size();
+        stats->bakedVoxels = volume.data.size();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return volume;
+}
+
+// Reads the vertices and faces of a Wavefront OBJ file, fanning polygons
+// into triangles. Texture coordinates, normals and groups are ignored.
+inline bool LoadObj(const std::string &path, Mesh &mesh)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    mesh.clear();
+    std::string line;
+    std::vector<uint32_t> face;
+    while (std::getline(file, line))
+    {
+        if (line.size() > 2 && line[0] == 'v' && line[1] == ' ')
+        {
+            double x = 0.0, y = 0.0, z = 0.0;
+            if (std::sscanf(line.c_str() + 2, "%lf %lf %lf", &x, &y, &z) == 3)
+                mesh.vertices.emplace_back(x, y, z);
+        }
+        else if (line.size() > 2 && line[0] == 'f' && line[1] == ' ')
+        {
+            face.clear();
+            const char *cursor = line.c_str() + 2;
+            while (*cursor)
+            {
+                char *next = nullptr;
+                const long index = std::strtol(cursor, &next, 10);
+                if (next == cursor)
+                    break;
+                face.push_back(uint32_t(index < 0 ? long(mesh.vertices.size()) + index : index - 1));
+                cursor = next;
+                while (*cursor && *cursor != ' ' && *cursor != '\t')
+                    ++cursor;
+                while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+                    ++cursor;
+            }
+            for (size_t i = 2; i < face.size(); ++i)
+                mesh.addTriangle(face[0], face[i - 1], face[i]);
+        }
+    }
+
+    for (uint32_t index : mesh.triangles)
+        if (index >= mesh.vertices.size())
+            return false;
+    return mesh.triangleCount() > 0;
+}
+
+}
+
+#endif // SDFBAKER_H
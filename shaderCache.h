@@ -0,0 +1,166 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <map>
+
+#include <QByteArray>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLShaderProgram>
+#include "logging.h"
+#include "shaders.h"
+
+namespace ShaderFeature
+{
+enum : unsigned
+{
+    None         = 0,
+    UniformColor = 1u << 0,
+    Instancing   = 1u << 1,
+    Wireframe    = 1u << 2,
+    Quantized    = 1u << 3,
+
+    // Selects the tessellated sphere pipeline (GL 4.0), which always takes
+    // its colour from the color uniform.
+    Tessellation = 1u << 4,
+
+    // Selects the bufferless sphere pipeline (GLSL 1.30), which draws
+    // without any vertex attributes.
+    Procedural   = 1u << 5,
+
+    // Selects the FXAA post-process pipeline.
+    Fxaa         = 1u << 6,
+
+    // Selects the ID pipeline used for GPU picking (GLSL 1.50).
+    Picking      = 1u << 7
+};
+}
+
+// A linked program for one feature combination together with its resolved
+// locations. Locations of inputs the variant does not use are -1.
+struct ShaderVariant
+{
+    QOpenGLShaderProgram *program = nullptr;
+
+    GLint posAttr = -1;
+    GLint colAttr = -1;
+    GLint baryAttr = -1;
+    GLint instanceAttr = -1;
+    GLint objectAttr = -1;
+
+    GLint matrixUniform = -1;
+    GLint colorUniform = -1;
+    GLint edgeColorUniform = -1;
+    GLint posScaleUniform = -1;
+    GLint tessLevelUniform = -1;
+    GLint levelUniform = -1;
+    GLint baseVerticesUniform = -1;
+    GLint baseFacesUniform = -1;
+    GLint sourceUniform = -1;
+    GLint texelSizeUniform = -1;
+    GLint uvScaleUniform = -1;
+    GLint uvMaxUniform = -1;
+    GLint objectIdUniform = -1;
+};
+
+// Builds shader variants on first use and keeps them for the lifetime of the
+// owner. Sources go through QOpenGLShaderProgram's cacheable path, so Qt stores
+// the linked program binary on disk and later runs skip compilation entirely.
+class ShaderCache final
+{
+public:
+    explicit ShaderCache(QObject *owner) : owner(owner) {}
+
+    const ShaderVariant &program(unsigned features)
+    {
+        auto it = variants.find(features);
+        if (it != variants.end())
+            return it->second;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        ShaderVariant variant;
+        variant.program = new QOpenGLShaderProgram(owner);
+        if (features & ShaderFeature::Tessellation)
+        {
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, withDefines(tessVertexShaderSource, features));
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::TessellationControl, withDefines(tessControlShaderSource, features));
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::TessellationEvaluation, withDefines(tessEvaluationShaderSource, features));
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, withDefines(tessFragmentShaderSource, features));
+        }
+        else if (features & ShaderFeature::Procedural)
+        {
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, withDefines(proceduralVertexShaderSource, features));
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, withDefines(proceduralFragmentShaderSource, features));
+        }
+        else if (features & ShaderFeature::Picking)
+        {
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, withDefines(pickVertexShaderSource, features));
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, withDefines(pickFragmentShaderSource, features));
+        }
+        else if (features & ShaderFeature::Fxaa)
+        {
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, withDefines(fxaaVertexShaderSource, features));
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, withDefines(fxaaFragmentShaderSource, features));
+        }
+        else
+        {
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, withDefines(vertexShaderSource, features));
+            variant.program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, withDefines(fragmentShaderSource, features));
+        }
+        if (!variant.program->link())
+            qWarning() << "shader variant" << features << "failed to link:" << variant.program->log();
+
+        variant.posAttr = variant.program->attributeLocation("posAttr");
+        Q_ASSERT(variant.posAttr != -1 || (features & ShaderFeature::Procedural));
+        variant.colAttr = variant.program->attributeLocation("colAttr");
+        variant.baryAttr = variant.program->attributeLocation("baryAttr");
+        variant.instanceAttr = variant.program->attributeLocation("instanceAttr");
+        variant.objectAttr = variant.program->attributeLocation("objectAttr");
+        variant.matrixUniform = variant.program->uniformLocation("matrix");
+        Q_ASSERT(variant.matrixUniform != -1 || (features & ShaderFeature::Fxaa));
+        variant.colorUniform = variant.program->uniformLocation("color");
+        variant.edgeColorUniform = variant.program->uniformLocation("edgeColor");
+        variant.posScaleUniform = variant.program->uniformLocation("posScale");
+        variant.tessLevelUniform = variant.program->uniformLocation("tessLevel");
+        variant.levelUniform = variant.program->uniformLocation("level");
+        variant.baseVerticesUniform = variant.program->uniformLocation("baseVertices");
+        variant.baseFacesUniform = variant.program->uniformLocation("baseFaces");
+        variant.sourceUniform = variant.program->uniformLocation("source");
+        variant.texelSizeUniform = variant.program->uniformLocation("texelSize");
+        variant.uvScaleUniform = variant.program->uniformLocation("uvScale");
+        variant.uvMaxUniform = variant.program->uniformLocation("uvMax");
+        variant.objectIdUniform = variant.program->uniformLocation("objectId");
+
+        qCDebug(lcShaders) << "shader variant" << features << "ready in" << timer.elapsed() << "ms";
+
+        return variants.emplace(features, variant).first->second;
+    }
+
+private:
+    static QByteArray withDefines(const char *source, unsigned features)
+    {
+        QByteArray defines;
+        if (features & ShaderFeature::UniformColor)
+            defines += "#define UNIFORM_COLOR\n";
+        if (features & ShaderFeature::Instancing)
+            defines += "#define INSTANCING\n";
+        if (features & ShaderFeature::Wireframe)
+            defines += "#define WIREFRAME\n";
+        if (features & ShaderFeature::Quantized)
+            defines += "#define QUANTIZED\n";
+
+        // A #version directive has to stay the first line of the shader.
+        QByteArray code(source);
+        int insertAt = 0;
+        if (code.startsWith("#version"))
+            insertAt = code.indexOf('\n') + 1;
+        return code.insert(insertAt, defines);
+    }
+
+    QObject *owner;
+    std::map<unsigned, ShaderVariant> variants;
+};
+
+#endif // SHADERCACHE_H
@@ -1,20 +1,274 @@
 #ifndef SHADERS_H
 #define SHADERS_H
 
-#endif // SHADERS_H
+// Every shader below is a template for a family of variants: ShaderCache
+// prepends one #define per enabled ShaderFeature before compiling it.
 
 static const char *vertexShaderSource =
     "attribute highp vec4 posAttr;\n"
+    "#ifndef UNIFORM_COLOR\n"
     "attribute lowp vec4 colAttr;\n"
+    "#else\n"
+    "uniform lowp vec4 color;\n"
+    "#endif\n"
+    "#ifdef INSTANCING\n"
+    "attribute highp mat4 instanceAttr;\n"
+    "#endif\n"
+    "#ifdef WIREFRAME\n"
+    "attribute lowp vec3 baryAttr;\n"
+    "varying lowp vec3 bary;\n"
+    "#endif\n"
+    "#ifdef QUANTIZED\n"
+    "uniform highp float posScale;\n"
+    "#endif\n"
     "varying lowp vec4 col;\n"
     "uniform highp mat4 matrix;\n"
     "void main() {\n"
+    "#ifdef UNIFORM_COLOR\n"
+    "   col = color;\n"
+    "#else\n"
     "   col = colAttr;\n"
-    "   gl_Position = matrix * posAttr;\n"
+    "#endif\n"
+    "#ifdef QUANTIZED\n"
+    "   highp vec4 pos = vec4(posAttr.xyz * posScale, 1.0);\n"
+    "#else\n"
+    "   highp vec4 pos = posAttr;\n"
+    "#endif\n"
+    "#ifdef INSTANCING\n"
+    "   pos = instanceAttr * pos;\n"
+    "#endif\n"
+    "#ifdef WIREFRAME\n"
+    "   bary = baryAttr;\n"
+    "#endif\n"
+    "   gl_Position = matrix * pos;\n"
     "}\n";
 
 static const char *fragmentShaderSource =
+    "#if defined(WIREFRAME) && defined(GL_ES)\n"
+    "#extension GL_OES_standard_derivatives : enable\n"
+    "#endif\n"
     "varying lowp vec4 col;\n"
+    "#ifdef WIREFRAME\n"
+    "varying lowp vec3 bary;\n"
+    "uniform lowp vec4 edgeColor;\n"
+    "#endif\n"
     "void main() {\n"
+    "#ifdef WIREFRAME\n"
+    "   lowp vec3 edge = smoothstep(vec3(0.0), fwidth(bary) * 1.5, bary);\n"
+    "   gl_FragColor = mix(edgeColor, col, min(min(edge.x, edge.y), edge.z));\n"
+    "#else\n"
     "   gl_FragColor = col;\n"
+    "#endif\n"
+    "}\n";
+
+// GPU refinement of the base icosahedron. Each face is a 3-vertex patch; the
+// evaluation stage projects every generated point back onto the unit sphere.
+// A level of 2^n splits every edge about as often as n CPU subdivisions, and
+// fractional spacing lets the level vary continuously in between. With
+// INSTANCING every instance is one object with its own level: tessLevel is
+// then the level per pixel of projected radius, scaled by the object's radius
+// over its distance from the eye.
+
+static const char *tessVertexShaderSource =
+    "#version 400\n"
+    "in vec3 posAttr;\n"
+    "out vec3 controlPos;\n"
+    "#ifdef INSTANCING\n"
+    "in mat4 instanceAttr;\n"
+    "out mat4 controlInstance;\n"
+    "#endif\n"
+    "void main() {\n"
+    "   controlPos = posAttr;\n"
+    "#ifdef INSTANCING\n"
+    "   controlInstance = instanceAttr;\n"
+    "#endif\n"
+    "}\n";
+
+static const char *tessControlShaderSource =
+    "#version 400\n"
+    "layout(vertices = 3) out;\n"
+    "in vec3 controlPos[];\n"
+    "out vec3 evaluationPos[];\n"
+    "#ifdef INSTANCING\n"
+    "in mat4 controlInstance[];\n"
+    "out mat4 evaluationInstance[];\n"
+    "#endif\n"
+    "uniform float tessLevel;\n"
+    "void main() {\n"
+    "   evaluationPos[gl_InvocationID] = controlPos[gl_InvocationID];\n"
+    "#ifdef INSTANCING\n"
+    "   evaluationInstance[gl_InvocationID] = controlInstance[gl_InvocationID];\n"
+    "#endif\n"
+    "   if (gl_InvocationID == 0) {\n"
+    "#ifdef INSTANCING\n"
+    "       mat4 m = controlInstance[0];\n"
+    "       float radius = length(m[0].xyz);\n"
+    "       float level = clamp(tessLevel * radius / max(length(m[3].xyz), radius), 1.0, 64.0);\n"
+    "#else\n"
+    "       float level = tessLevel;\n"
+    "#endif\n"
+    "       gl_TessLevelInner[0] = level;\n"
+    "       gl_TessLevelOuter[0] = level;\n"
+    "       gl_TessLevelOuter[1] = level;\n"
+    "       gl_TessLevelOuter[2] = level;\n"
+    "   }\n"
+    "}\n";
+
+static const char *tessEvaluationShaderSource =
+    "#version 400\n"
+    "layout(triangles, fractional_odd_spacing, ccw) in;\n"
+    "in vec3 evaluationPos[];\n"
+    "#ifdef INSTANCING\n"
+    "in mat4 evaluationInstance[];\n"
+    "#endif\n"
+    "out vec4 col;\n"
+    "uniform mat4 matrix;\n"
+    "uniform vec4 color;\n"
+    "void main() {\n"
+    "   vec3 pos = gl_TessCoord.x * evaluationPos[0]\n"
+    "            + gl_TessCoord.y * evaluationPos[1]\n"
+    "            + gl_TessCoord.z * evaluationPos[2];\n"
+    "   col = color;\n"
+    "#ifdef INSTANCING\n"
+    "   gl_Position = matrix * (evaluationInstance[0] * vec4(normalize(pos), 1.0));\n"
+    "#else\n"
+    "   gl_Position = matrix * vec4(normalize(pos), 1.0);\n"
+    "#endif\n"
+    "}\n";
+
+static const char *tessFragmentShaderSource =
+    "#version 400\n"
+    "in vec4 col;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "   fragColor = col;\n"
+    "}\n";
+
+// Bufferless icosphere. Vertex i belongs to triangle i/3 of the level-n mesh,
+// whose index holds the base face in its top bits and one child choice per
+// level in the 2-bit groups below, in the order SubdivideMesh emits children.
+// Walking those digits down from the base face rebuilds the exact triangle.
+
+static const char *proceduralVertexShaderSource =
+    "#version 130\n"
+    "uniform vec3 baseVertices[12];\n"
+    "uniform int baseFaces[60];\n"
+    "uniform int level;\n"
+    "uniform mat4 matrix;\n"
+    "#ifdef UNIFORM_COLOR\n"
+    "uniform vec4 color;\n"
+    "#endif\n"
+    "out vec4 col;\n"
+    "void main() {\n"
+    "   int triangle = gl_VertexID / 3;\n"
+    "   int corner = gl_VertexID - triangle * 3;\n"
+    "   int face = triangle >> (2 * level);\n"
+    "   vec3 a = baseVertices[baseFaces[face * 3]];\n"
+    "   vec3 b = baseVertices[baseFaces[face * 3 + 1]];\n"
+    "   vec3 c = baseVertices[baseFaces[face * 3 + 2]];\n"
+    "   for (int l = level - 1; l >= 0; --l) {\n"
+    "       int child = (triangle >> (2 * l)) & 3;\n"
+    "       vec3 ab = normalize(a + b);\n"
+    "       vec3 bc = normalize(b + c);\n"
+    "       vec3 ca = normalize(c + a);\n"
+    "       if (child == 0) { b = ab; c = ca; }\n"
+    "       else if (child == 1) { a = ab; c = bc; }\n"
+    "       else if (child == 2) { a = bc; b = c; c = ca; }\n"
+    "       else { a = ab; b = bc; c = ca; }\n"
+    "   }\n"
+    "#ifdef UNIFORM_COLOR\n"
+    "   col = color;\n"
+    "#else\n"
+    "   int triangles = 20 << (2 * level);\n"
+    "   col = vec4(0.1, 0.5 + 0.5 * float(triangle) / float(triangles), 0.1, 1.0);\n"
+    "#endif\n"
+    "   vec3 pos = corner == 0 ? a : (corner == 1 ? b : c);\n"
+    "   gl_Position = matrix * vec4(pos, 1.0);\n"
+    "}\n";
+
+static const char *proceduralFragmentShaderSource =
+    "#version 130\n"
+    "in vec4 col;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "   fragColor = col;\n"
+    "}\n";
+
+// Single-pass FXAA-style resolve of an offscreen colour buffer, drawn as one
+// triangle covering the screen. uvScale selects the part of the buffer that
+// holds the frame when rendering below window resolution.
+
+static const char *fxaaVertexShaderSource =
+    "attribute highp vec4 posAttr;\n"
+    "uniform highp vec2 uvScale;\n"
+    "varying highp vec2 uv;\n"
+    "void main() {\n"
+    "   uv = (posAttr.xy * 0.5 + 0.5) * uvScale;\n"
+    "   gl_Position = vec4(posAttr.xy, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *fxaaFragmentShaderSource =
+    "uniform sampler2D source;\n"
+    "uniform highp vec2 texelSize;\n"
+    "uniform highp vec2 uvMax;\n"
+    "varying highp vec2 uv;\n"
+    "lowp vec3 fetch(highp vec2 p) {\n"
+    "   return texture2D(source, clamp(p, 0.5 * texelSize, uvMax)).rgb;\n"
+    "}\n"
+    "void main() {\n"
+    "   const lowp vec3 lumaWeights = vec3(0.299, 0.587, 0.114);\n"
+    "   lowp vec3 rgbM = fetch(uv);\n"
+    "   lowp float lumaNW = dot(fetch(uv + vec2(-1.0, -1.0) * texelSize), lumaWeights);\n"
+    "   lowp float lumaNE = dot(fetch(uv + vec2( 1.0, -1.0) * texelSize), lumaWeights);\n"
+    "   lowp float lumaSW = dot(fetch(uv + vec2(-1.0,  1.0) * texelSize), lumaWeights);\n"
+    "   lowp float lumaSE = dot(fetch(uv + vec2( 1.0,  1.0) * texelSize), lumaWeights);\n"
+    "   lowp float lumaM = dot(rgbM, lumaWeights);\n"
+    "   lowp float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));\n"
+    "   lowp float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));\n"
+    "   highp vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));\n"
+    "   highp float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * (0.25 / 8.0), 1.0 / 128.0);\n"
+    "   highp float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);\n"
+    "   dir = clamp(dir * rcpDirMin, vec2(-8.0), vec2(8.0)) * texelSize;\n"
+    "   lowp vec3 rgbA = 0.5 * (fetch(uv + dir * (1.0 / 3.0 - 0.5))\n"
+    "                         + fetch(uv + dir * (2.0 / 3.0 - 0.5)));\n"
+    "   lowp vec3 rgbB = rgbA * 0.5 + 0.25 * (fetch(uv - dir * 0.5)\n"
+    "                                       + fetch(uv + dir * 0.5));\n"
+    "   lowp float lumaB = dot(rgbB, lumaWeights);\n"
+    "   gl_FragColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB, 1.0);\n"
     "}\n";
+
+// Object and triangle IDs for GPU picking, written to an unsigned integer
+// target. Zero means background, so object IDs are stored plus one. objectId
+// is a signed int because Qt 5 sets integer uniforms with glUniform1i, which
+// fails on a uint uniform.
+
+static const char *pickVertexShaderSource =
+    "#version 150\n"
+    "in vec4 posAttr;\n"
+    "#ifdef INSTANCING\n"
+    "in mat4 instanceAttr;\n"
+    "in uint objectAttr;\n"
+    "#else\n"
+    "uniform int objectId;\n"
+    "#endif\n"
+    "uniform mat4 matrix;\n"
+    "flat out uint object;\n"
+    "void main() {\n"
+    "#ifdef INSTANCING\n"
+    "   object = objectAttr;\n"
+    "   gl_Position = matrix * (instanceAttr * posAttr);\n"
+    "#else\n"
+    "   object = uint(objectId);\n"
+    "   gl_Position = matrix * posAttr;\n"
+    "#endif\n"
+    "}\n";
+
+static const char *pickFragmentShaderSource =
+    "#version 150\n"
+    "flat in uint object;\n"
+    "out uvec2 pickId;\n"
+    "void main() {\n"
+    "   pickId = uvec2(object + 1u, uint(gl_PrimitiveID));\n"
+    "}\n";
+
+#endif // SHADERS_H